@@ -0,0 +1,288 @@
+#define _GNU_SOURCE
+
+#include <sys/param.h>
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "affinity.h"
+#include "syscallmeter.h"
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+
+typedef struct cpu_topo {
+	int cpu;
+	int package;
+	int core;
+	int thread; /* Index among SMT siblings of the core */
+} cpu_topo_t;
+
+/*
+ * Parse "0-3,8,10-11" style CPU list into an array.
+ * Returns number of CPUs or -1 on malformed input.
+ */
+int
+affinity_parse_list(const char *str, int *cpus, int max)
+{
+	const char *p;
+	char *end;
+	long first, last;
+	int n;
+
+	n = 0;
+	p = str;
+	while (*p != '\0' && *p != '\n') {
+		first = strtol(p, &end, 10);
+		if (end == p || first < 0 || first >= CPU_SETSIZE)
+			return (-1);
+		last = first;
+		p = end;
+		if (*p == '-') {
+			p++;
+			last = strtol(p, &end, 10);
+			if (end == p || last < first || last >= CPU_SETSIZE)
+				return (-1);
+			p = end;
+		}
+		for (long c = first; c <= last && n < max; c++)
+			cpus[n++] = (int)c;
+		if (*p == ',')
+			p++;
+		else if (*p != '\0' && *p != '\n')
+			return (-1);
+	}
+
+	return (n);
+}
+
+static int
+read_sysfs_int(const char *path, int def)
+{
+	FILE *f;
+	int val;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		return (def);
+	if (fscanf(f, "%d", &val) != 1)
+		val = def;
+	fclose(f);
+	return (val);
+}
+
+static int
+read_topology(struct cpu_topo *topo, int max)
+{
+	char path[256], buf[4096];
+	int cpus[CPU_SETSIZE];
+	FILE *f;
+	int n;
+
+	f = fopen(SYSFS_CPU "/online", "r");
+	if (f == NULL || fgets(buf, sizeof(buf), f) == NULL) {
+		if (f != NULL)
+			fclose(f);
+		printf("Can't read %s/online\n", SYSFS_CPU);
+		return (-1);
+	}
+	fclose(f);
+
+	n = affinity_parse_list(buf, cpus, MIN(max, CPU_SETSIZE));
+	if (n <= 0) {
+		printf("Can't parse list of online CPUs: %s", buf);
+		return (-1);
+	}
+
+	for (int i = 0; i < n; i++) {
+		topo[i].cpu = cpus[i];
+		snprintf(path, sizeof(path),
+		    SYSFS_CPU "/cpu%d/topology/physical_package_id", cpus[i]);
+		topo[i].package = read_sysfs_int(path, 0);
+		snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/core_id",
+		    cpus[i]);
+		topo[i].core = read_sysfs_int(path, cpus[i]);
+		topo[i].thread = 0;
+		for (int j = 0; j < i; j++) {
+			if (topo[j].package == topo[i].package &&
+			    topo[j].core == topo[i].core)
+				topo[i].thread++;
+		}
+	}
+
+	return (n);
+}
+
+/* Compact: fill a core (with SMT siblings), then a socket, then the next */
+static int
+cmp_compact(const void *a, const void *b)
+{
+	const struct cpu_topo *x = a, *y = b;
+
+	if (x->package != y->package)
+		return (x->package - y->package);
+	if (x->core != y->core)
+		return (x->core - y->core);
+	return (x->cpu - y->cpu);
+}
+
+/* Physical cores first, SMT siblings after; sockets interleaved later */
+static int
+cmp_cores_first(const void *a, const void *b)
+{
+	const struct cpu_topo *x = a, *y = b;
+
+	if (x->thread != y->thread)
+		return (x->thread - y->thread);
+	return (cmp_compact(a, b));
+}
+
+/*
+ * Round-robin over sockets: worker i lands on socket (i % nsockets),
+ * taking physical cores before SMT siblings within each socket.
+ */
+static int
+order_scatter(struct cpu_topo *topo, int n, int *map)
+{
+	int packages[CPU_SETSIZE];
+	int taken[CPU_SETSIZE];
+	int npackages, count;
+
+	qsort(topo, n, sizeof(struct cpu_topo), cmp_cores_first);
+
+	npackages = 0;
+	for (int i = 0; i < n; i++) {
+		int j;
+		for (j = 0; j < npackages; j++)
+			if (packages[j] == topo[i].package)
+				break;
+		if (j == npackages)
+			packages[npackages++] = topo[i].package;
+		taken[i] = 0;
+	}
+
+	count = 0;
+	while (count < n) {
+		for (int p = 0; p < npackages; p++) {
+			for (int i = 0; i < n; i++) {
+				if (!taken[i] && topo[i].package == packages[p]) {
+					taken[i] = 1;
+					map[count++] = topo[i].cpu;
+					break;
+				}
+			}
+		}
+	}
+
+	return (count);
+}
+
+static int
+build_map(struct meter_settings *s, int *map)
+{
+	struct cpu_topo *topo;
+	int n, count;
+
+	if (strcmp(s->placement, "compact") != 0 &&
+	    strcmp(s->placement, "scatter") != 0 &&
+	    strcmp(s->placement, "core") != 0) {
+		count = affinity_parse_list(s->placement, map, CPU_SETSIZE);
+		if (count <= 0) {
+			printf(
+			    "invalid arg %s for option -a expected compact, scatter, core or CPU list\n",
+			    s->placement);
+			return (-1);
+		}
+		return (count);
+	}
+
+	topo = calloc(CPU_SETSIZE, sizeof(struct cpu_topo));
+	if (topo == NULL) {
+		printf("Can't allocate topology\n");
+		return (-1);
+	}
+
+	n = read_topology(topo, CPU_SETSIZE);
+	if (n < 0) {
+		free(topo);
+		return (-1);
+	}
+
+	count = 0;
+	if (strcmp(s->placement, "scatter") == 0) {
+		count = order_scatter(topo, n, map);
+	} else {
+		qsort(topo, n, sizeof(struct cpu_topo), cmp_compact);
+		for (int i = 0; i < n; i++) {
+			if (strcmp(s->placement, "core") == 0 &&
+			    topo[i].thread != 0)
+				continue;
+			map[count++] = topo[i].cpu;
+		}
+	}
+
+	free(topo);
+	return (count);
+}
+
+/*
+ * Build worker to CPU mapping for -a. Explicit CPU list also defines
+ * the number of workers (still bounded by -j).
+ */
+int
+affinity_init(struct meter_settings *s)
+{
+	int map[CPU_SETSIZE];
+	int count;
+	char used[CPU_SETSIZE];
+
+	s->parent_cpu = -1;
+	if (s->placement == NULL)
+		return (0);
+
+	count = build_map(s, map);
+	if (count < 0)
+		return (-1);
+
+	if (strcmp(s->placement, "compact") != 0 &&
+	    strcmp(s->placement, "scatter") != 0 &&
+	    strcmp(s->placement, "core") != 0)
+		s->ncpu = MIN(count, MIN(s->cpu_limit, MAX_WORKERS));
+
+	if (count < s->ncpu)
+		printf("Warning! Only %d CPUs for %ld workers, sharing CPUs\n",
+		    count, s->ncpu);
+
+	memset(used, 0, sizeof(used));
+	for (long i = 0; i < s->ncpu; i++) {
+		s->cpu_map[i] = map[i % count];
+		used[s->cpu_map[i]] = 1;
+	}
+
+	/* Keep the parent away from workers if there is a spare CPU */
+	for (int i = 0; i < count; i++) {
+		if (!used[map[i]]) {
+			s->parent_cpu = map[i];
+			break;
+		}
+	}
+
+	printf("Placement: %s\n", s->placement);
+	for (long i = 0; i < s->ncpu; i++)
+		printf("\tworker %ld -> cpu %d\n", i, s->cpu_map[i]);
+	if (s->parent_cpu >= 0)
+		printf("\tparent -> cpu %d\n", s->parent_cpu);
+
+	return (0);
+}
+
+int
+affinity_pin(int cpu)
+{
+	cpu_set_t mask;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	return (sched_setaffinity(0, sizeof(cpu_set_t), &mask));
+}
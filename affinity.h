@@ -0,0 +1,10 @@
+#ifndef _AFFINITY_H_
+#define _AFFINITY_H_
+
+#include "syscallmeter.h"
+
+int affinity_parse_list(const char *, int *, int);
+int affinity_init(struct meter_settings *);
+int affinity_pin(int);
+
+#endif /* !_AFFINITY_H_ */
@@ -0,0 +1,162 @@
+#include <emmintrin.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "datagen.h"
+#include "syscallmeter.h"
+
+int
+datagen_parse(struct meter_data *d, const char *arg)
+{
+	char *end;
+
+	if (strcmp(arg, "random") == 0) {
+		d->mode = DATA_RANDOM;
+	} else if (strcmp(arg, "zero") == 0) {
+		d->mode = DATA_ZERO;
+	} else if (strcmp(arg, "text") == 0) {
+		d->mode = DATA_TEXT;
+	} else if (strncmp(arg, "ratio=", 6) == 0) {
+		errno = 0;
+		d->mode = DATA_RATIO;
+		d->ratio = strtod(arg + 6, &end);
+		if (errno != 0 || end == arg + 6 || *end != '\0' ||
+		    !(d->ratio >= 0.0 && d->ratio <= 1.0))
+			return (-1);
+	} else {
+		return (-1);
+	}
+	return (0);
+}
+
+void
+datagen_name(const struct meter_data *d, char *buf, size_t len)
+{
+	switch (d->mode) {
+	case DATA_ZERO:
+		snprintf(buf, len, "zero");
+		break;
+	case DATA_RATIO:
+		snprintf(buf, len, "ratio=%.3f", d->ratio);
+		break;
+	case DATA_TEXT:
+		snprintf(buf, len, "text");
+		break;
+	default:
+		snprintf(buf, len, "random");
+		break;
+	}
+}
+
+static uint64_t
+splitmix64(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return (z ^ (z >> 31));
+}
+
+/*
+ * Four xorshift128 generators side by side, one per 32-bit lane of the
+ * SSE2 registers, so every step yields 16 bytes with shifts and xors only.
+ */
+typedef struct datagen_rng {
+	__m128i x, y, z, w;
+} datagen_rng_t;
+
+static void
+rng_seed(struct datagen_rng *r, uint64_t seed)
+{
+	uint64_t v[8];
+
+	for (int i = 0; i < 8; i++)
+		v[i] = splitmix64(&seed) | 1;
+	r->x = _mm_set_epi64x(v[0], v[1]);
+	r->y = _mm_set_epi64x(v[2], v[3]);
+	r->z = _mm_set_epi64x(v[4], v[5]);
+	r->w = _mm_set_epi64x(v[6], v[7]);
+}
+
+static inline __m128i
+rng_next(struct datagen_rng *r)
+{
+	__m128i t;
+
+	t = _mm_xor_si128(r->x, _mm_slli_epi32(r->x, 11));
+	r->x = r->y;
+	r->y = r->z;
+	r->z = r->w;
+	r->w = _mm_xor_si128(_mm_xor_si128(r->w, _mm_srli_epi32(r->w, 19)),
+	    _mm_xor_si128(t, _mm_srli_epi32(t, 8)));
+	return (r->w);
+}
+
+static void
+fill_random(struct datagen_rng *r, char *buf, size_t len)
+{
+	__m128i v;
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16)
+		_mm_storeu_si128((__m128i *)(buf + i), rng_next(r));
+	if (i < len) {
+		v = rng_next(r);
+		memcpy(buf + i, &v, len - i);
+	}
+}
+
+/* Fill buf with the --data pattern, seed makes different buffers differ */
+void
+datagen_fill(const struct meter_data *d, void *buf, size_t len, uint64_t seed)
+{
+	struct datagen_rng r;
+	char *p = buf;
+	size_t rnd;
+	unsigned int g_seed;
+
+	switch (d->mode) {
+	case DATA_ZERO:
+		memset(p, 0, len);
+		break;
+	case DATA_RATIO:
+		rng_seed(&r, seed);
+		rnd = (size_t)(d->ratio * DATAGEN_BLOCK + 0.5);
+		for (size_t off = 0; off < len; off += DATAGEN_BLOCK) {
+			size_t n = MIN(DATAGEN_BLOCK, len - off);
+
+			fill_random(&r, p + off, MIN(rnd, n));
+			if (n > rnd)
+				memset(p + off + rnd, 0, n - rnd);
+		}
+		break;
+	case DATA_TEXT:
+		g_seed = (unsigned int)seed;
+		for (size_t i = 0; i < len; i++) {
+			g_seed = (214013 * g_seed + 2531011);
+			p[i] = 'A' + (char)(((g_seed >> 16) & 0x7FFF) % 0x1a);
+		}
+		break;
+	default:
+		rng_seed(&r, seed);
+		fill_random(&r, p, len);
+		break;
+	}
+}
+
+/* Payload buffer in the --data pattern of the run */
+char *
+alloc_rndbytes(struct meter_settings *s, size_t size)
+{
+	char *ret;
+
+	ret = malloc(size);
+	if (ret == NULL)
+		return (ret);
+
+	datagen_fill(&s->data, ret, size, random());
+	return (ret);
+}
@@ -0,0 +1,30 @@
+#ifndef _DATAGEN_H_
+#define _DATAGEN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Payload written by the workloads (--data). Compressing filesystems
+ * store zero and ratio data in fewer bytes than the workload writes.
+ */
+enum datagen_mode {
+	DATA_RANDOM, /* Incompressible */
+	DATA_ZERO,   /* All zero bytes */
+	DATA_RATIO,  /* Random prefix of every block, zero tail */
+	DATA_TEXT    /* Letters 'A'..'Z', the historical pattern */
+};
+
+/* Bytes of every DATA_RATIO block, the random part is ratio of it */
+#define DATAGEN_BLOCK 4096
+
+typedef struct meter_data {
+	enum datagen_mode mode;
+	double ratio; /* Compressed to original size for DATA_RATIO */
+} meter_data_t;
+
+int datagen_parse(struct meter_data *, const char *);
+void datagen_name(const struct meter_data *, char *, size_t);
+void datagen_fill(const struct meter_data *, void *, size_t, uint64_t);
+
+#endif /* !_DATAGEN_H_ */
@@ -0,0 +1,26 @@
+#ifndef _FUTEX_H_
+#define _FUTEX_H_
+
+#include <sys/syscall.h>
+
+#include <linux/futex.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/*
+ * Futex words live in MAP_SHARED memory used by forked workers as well,
+ * so the shared (not FUTEX_PRIVATE_FLAG) variants are used.
+ */
+static inline int
+futex_wait(uint32_t *addr, uint32_t val)
+{
+	return (syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0));
+}
+
+static inline int
+futex_wake(uint32_t *addr, int count)
+{
+	return (syscall(SYS_futex, addr, FUTEX_WAKE, count, NULL, NULL, 0));
+}
+
+#endif /* !_FUTEX_H_ */
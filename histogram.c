@@ -0,0 +1,69 @@
+#include <sys/param.h>
+
+#include <string.h>
+
+#include "histogram.h"
+
+/* Highest value which falls into the bucket */
+static uint64_t
+histo_bucket_top(int index)
+{
+	int shift;
+
+	if (index < HISTO_SUB_COUNT)
+		return ((uint64_t)index);
+
+	shift = (index >> HISTO_SUB_BITS) - 1;
+	return ((((uint64_t)HISTO_SUB_COUNT + (index & (HISTO_SUB_COUNT - 1)))
+		    << shift) +
+	    ((1ULL << shift) - 1));
+}
+
+void
+histo_reset(struct meter_histo *h)
+{
+	memset(h, 0, sizeof(struct meter_histo));
+}
+
+void
+histo_merge(struct meter_histo *dst, const struct meter_histo *src)
+{
+	if (src->count == 0)
+		return;
+
+	for (int i = 0; i < HISTO_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (dst->max < src->max)
+		dst->max = src->max;
+}
+
+/*
+ * Returns upper bound of the bucket holding the given percentile (0..100),
+ * clamped by the largest recorded value.
+ */
+uint64_t
+histo_percentile(const struct meter_histo *h, double pct)
+{
+	uint64_t rank, seen;
+
+	if (h->count == 0)
+		return (0);
+
+	rank = (uint64_t)((pct / 100.0) * (double)h->count + 0.5);
+	if (rank == 0)
+		rank = 1;
+	if (rank > h->count)
+		rank = h->count;
+
+	seen = 0;
+	for (int i = 0; i < HISTO_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank)
+			return (MIN(histo_bucket_top(i), h->max));
+	}
+
+	return (h->max);
+}
@@ -0,0 +1,49 @@
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <stdint.h>
+
+/*
+ * Log-linear (HDR-style) histogram. Values below HISTO_SUB_COUNT have exact
+ * buckets, every next power of two is split into HISTO_SUB_COUNT linear
+ * buckets, so relative error of a bucket is below 1 / HISTO_SUB_COUNT.
+ */
+#define HISTO_SUB_BITS	5
+#define HISTO_SUB_COUNT (1 << HISTO_SUB_BITS)
+#define HISTO_BUCKETS	((64 - HISTO_SUB_BITS + 1) * HISTO_SUB_COUNT)
+
+typedef struct meter_histo {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[HISTO_BUCKETS];
+} meter_histo_t;
+
+static inline int
+histo_index(uint64_t value)
+{
+	int shift;
+
+	if (value < HISTO_SUB_COUNT)
+		return ((int)value);
+
+	shift = 63 - __builtin_clzll(value) - HISTO_SUB_BITS;
+	return (((shift + 1) << HISTO_SUB_BITS) +
+	    (int)((value >> shift) & (HISTO_SUB_COUNT - 1)));
+}
+
+static inline void
+histo_record(struct meter_histo *h, uint64_t value)
+{
+	h->buckets[histo_index(value)]++;
+	h->count++;
+	h->sum += value;
+	if (h->max < value)
+		h->max = value;
+}
+
+void histo_reset(struct meter_histo *);
+void histo_merge(struct meter_histo *, const struct meter_histo *);
+uint64_t histo_percentile(const struct meter_histo *, double);
+
+#endif /* !_HISTOGRAM_H_ */
@@ -0,0 +1,297 @@
+#include <sys/mman.h>
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "futex.h"
+#include "lock.h"
+
+/* Locks created by the workload, the parent reports all of them */
+#define LOCK_MAX 8
+
+static struct meter_lock *locks[LOCK_MAX];
+static int nlocks;
+
+static const char *lock_names[] = { "sem", "futex", "ticket", "mcs" };
+
+int
+lock_parse(const char *arg, enum meter_lock_kind *kind)
+{
+	for (unsigned i = 0; i < sizeof(lock_names) / sizeof(lock_names[0]);
+	     i++) {
+		if (strcmp(arg, lock_names[i]) == 0) {
+			*kind = i;
+			return (0);
+		}
+	}
+	return (-1);
+}
+
+const char *
+lock_kind_name(enum meter_lock_kind kind)
+{
+	return (lock_names[kind]);
+}
+
+/* Only LOCK_SEM admits count > 1 holders at once */
+struct meter_lock *
+lock_create(const char *name, enum meter_lock_kind kind, unsigned count)
+{
+	struct meter_lock *l;
+
+	if (nlocks == LOCK_MAX || (kind != LOCK_SEM && count != 1)) {
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	l = mmap(0, sizeof(struct meter_lock), PROT_READ | PROT_WRITE,
+	    MAP_ANON | MAP_SHARED, -1, 0);
+	if (l == MAP_FAILED)
+		return (NULL);
+
+	l->kind = kind;
+	l->count = count;
+	snprintf(l->name, sizeof(l->name), "%s", name);
+	sem_init(&l->sem, 1, count);
+	locks[nlocks++] = l;
+	return (l);
+}
+
+/* Free the lock and drop the stats, no worker may hold or wait for it */
+void
+lock_reset(struct meter_lock *l, long ncpu)
+{
+	sem_destroy(&l->sem);
+	sem_init(&l->sem, 1, l->count);
+	l->futex = 0;
+	l->ticket_next = 0;
+	l->ticket_owner = 0;
+	l->mcs_tail = 0;
+	memset(l->stats, 0, sizeof(struct meter_lock_stats) * ncpu);
+}
+
+/* Spinning waiters give the CPU away now and then, workers may outnumber CPUs */
+static inline void
+lock_spin(unsigned *spins)
+{
+	if (++(*spins) % 128 == 0)
+		sched_yield();
+	else
+		__builtin_ia32_pause();
+}
+
+static int
+sem_lock(struct meter_lock *l)
+{
+	if (sem_trywait(&l->sem) == 0)
+		return (0);
+	while (sem_wait(&l->sem) != 0) {
+		if (errno != EINTR) {
+			printf("sem_wait failed with error %s\n",
+			    strerror(errno));
+			exit(-1);
+		}
+	}
+	return (1);
+}
+
+/* 0 - free, 1 - locked, 2 - locked and somebody may sleep on it */
+static int
+futex_lock(struct meter_lock *l)
+{
+	uint32_t c = 0;
+
+	if (__atomic_compare_exchange_n(&l->futex, &c, 1, 0, __ATOMIC_ACQUIRE,
+		__ATOMIC_RELAXED))
+		return (0);
+
+	if (c != 2)
+		c = __atomic_exchange_n(&l->futex, 2, __ATOMIC_ACQUIRE);
+	while (c != 0) {
+		futex_wait(&l->futex, 2);
+		c = __atomic_exchange_n(&l->futex, 2, __ATOMIC_ACQUIRE);
+	}
+	return (1);
+}
+
+static void
+futex_unlock(struct meter_lock *l)
+{
+	if (__atomic_fetch_sub(&l->futex, 1, __ATOMIC_RELEASE) != 1) {
+		__atomic_store_n(&l->futex, 0, __ATOMIC_RELEASE);
+		futex_wake(&l->futex, 1);
+	}
+}
+
+static int
+ticket_lock(struct meter_lock *l)
+{
+	uint32_t ticket;
+	unsigned spins = 0;
+
+	ticket = __atomic_fetch_add(&l->ticket_next, 1, __ATOMIC_RELAXED);
+	if (__atomic_load_n(&l->ticket_owner, __ATOMIC_ACQUIRE) == ticket)
+		return (0);
+	while (__atomic_load_n(&l->ticket_owner, __ATOMIC_ACQUIRE) != ticket)
+		lock_spin(&spins);
+	return (1);
+}
+
+static void
+ticket_unlock(struct meter_lock *l)
+{
+	__atomic_store_n(&l->ticket_owner, l->ticket_owner + 1,
+	    __ATOMIC_RELEASE);
+}
+
+static int
+mcs_lock(struct meter_lock *l, int id)
+{
+	struct meter_mcs_node *node = &l->mcs[id];
+	uint32_t prev;
+	unsigned spins = 0;
+
+	node->next = 0;
+	node->locked = 1;
+	prev = __atomic_exchange_n(&l->mcs_tail, id + 1, __ATOMIC_ACQ_REL);
+	if (prev == 0)
+		return (0);
+
+	__atomic_store_n(&l->mcs[prev - 1].next, id + 1, __ATOMIC_RELEASE);
+	while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE))
+		lock_spin(&spins);
+	return (1);
+}
+
+static void
+mcs_unlock(struct meter_lock *l, int id)
+{
+	struct meter_mcs_node *node = &l->mcs[id];
+	uint32_t self = id + 1, next;
+	unsigned spins = 0;
+
+	next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+	if (next == 0) {
+		if (__atomic_compare_exchange_n(&l->mcs_tail, &self, 0, 0,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			return;
+		/* A successor swapped the tail but has not linked in yet */
+		while ((next = __atomic_load_n(&node->next,
+			    __ATOMIC_ACQUIRE)) == 0)
+			lock_spin(&spins);
+	}
+	__atomic_store_n(&l->mcs[next - 1].locked, 0, __ATOMIC_RELEASE);
+}
+
+/* Returns ticks spent waiting */
+uint64_t
+lock_acquire(struct meter_lock *l, struct meter_worker_state *s)
+{
+	struct meter_lock_stats *st = &l->stats[s->id];
+	uint64_t start, now;
+	int contended;
+
+	start = vi_tmGetTicks();
+	switch (l->kind) {
+	case LOCK_FUTEX:
+		contended = futex_lock(l);
+		break;
+	case LOCK_TICKET:
+		contended = ticket_lock(l);
+		break;
+	case LOCK_MCS:
+		contended = mcs_lock(l, s->id);
+		break;
+	default:
+		contended = sem_lock(l);
+		break;
+	}
+	now = vi_tmGetTicks();
+
+	st->since = now;
+	if (meter_measuring(s)) {
+		st->acquired++;
+		st->contended += contended;
+		histo_record(&st->wait, now - start);
+	}
+	return (now - start);
+}
+
+void
+lock_release(struct meter_lock *l, struct meter_worker_state *s)
+{
+	struct meter_lock_stats *st = &l->stats[s->id];
+
+	if (meter_measuring(s))
+		histo_record(&st->hold, vi_tmGetTicks() - st->since);
+
+	switch (l->kind) {
+	case LOCK_FUTEX:
+		futex_unlock(l);
+		break;
+	case LOCK_TICKET:
+		ticket_unlock(l);
+		break;
+	case LOCK_MCS:
+		mcs_unlock(l, s->id);
+		break;
+	default:
+		if (sem_post(&l->sem) != 0) {
+			printf("sem_post failed with error %s\n",
+			    strerror(errno));
+			exit(-1);
+		}
+		break;
+	}
+}
+
+/* One row per lock, stats of all workers merged */
+void
+lock_report(struct meter_settings *s)
+{
+	struct meter_histo *wait, *hold;
+	uint64_t acquired, contended;
+	double tick = s->ns_per_tick;
+
+	if (nlocks == 0)
+		return;
+
+	wait = malloc(sizeof(struct meter_histo) * 2);
+	if (wait == NULL) {
+		printf("Can't allocate lock results\n");
+		return;
+	}
+	hold = wait + 1;
+
+	printf("Locks (ns):\n");
+	printf("%-10s %-6s %12s %10s %10s %10s %10s %10s %10s\n", "lock",
+	    "kind", "acquired", "contended", "wait avg", "wait p99",
+	    "wait max", "hold avg", "hold p99");
+	for (int i = 0; i < nlocks; i++) {
+		struct meter_lock *l = locks[i];
+
+		histo_reset(wait);
+		histo_reset(hold);
+		acquired = contended = 0;
+		for (long w = 0; w < s->ncpu; w++) {
+			acquired += l->stats[w].acquired;
+			contended += l->stats[w].contended;
+			histo_merge(wait, &l->stats[w].wait);
+			histo_merge(hold, &l->stats[w].hold);
+		}
+		if (acquired == 0)
+			continue;
+		printf("%-10s %-6s %12lu %9.1f%% %10.0f %10.0f %10.0f %10.0f "
+		       "%10.0f\n",
+		    l->name, lock_kind_name(l->kind), acquired,
+		    100.0 * contended / acquired,
+		    tick * wait->sum / MAX(wait->count, 1),
+		    tick * histo_percentile(wait, 99.0), tick * wait->max,
+		    tick * hold->sum / MAX(hold->count, 1),
+		    tick * histo_percentile(hold, 99.0));
+	}
+	free(wait);
+}
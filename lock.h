@@ -0,0 +1,56 @@
+#ifndef _LOCK_H_
+#define _LOCK_H_
+
+#include <semaphore.h>
+#include <stdint.h>
+
+#include "histogram.h"
+#include "syscallmeter.h"
+
+/*
+ * Cross-process lock with contention accounting. A lock lives in its own
+ * MAP_SHARED mapping, so it works for forked workers and threads alike.
+ * Sem - POSIX semaphore, the only kind that admits count > 1 holders
+ * Futex - three-state futex mutex (free, locked, contended)
+ * Ticket - FIFO ticket spinlock
+ * MCS - queue spinlock, every waiter spins on its own node
+ */
+enum meter_lock_kind { LOCK_SEM, LOCK_FUTEX, LOCK_TICKET, LOCK_MCS };
+
+/* Per worker, measured window only */
+typedef struct meter_lock_stats {
+	uint64_t acquired;
+	uint64_t contended; /* Had to wait for another holder */
+	uint64_t since;	    /* Tick of the last acquisition */
+	struct meter_histo wait; /* Ticks */
+	struct meter_histo hold;
+} __attribute__((aligned(CACHELINE_SIZE))) meter_lock_stats_t;
+
+typedef struct meter_mcs_node {
+	uint32_t next; /* Worker id + 1 of the successor, 0 if none */
+	uint32_t locked;
+} __attribute__((aligned(CACHELINE_SIZE))) meter_mcs_node_t;
+
+typedef struct meter_lock {
+	enum meter_lock_kind kind;
+	char name[32];
+	unsigned count;
+	sem_t sem;
+	uint32_t futex __attribute__((aligned(CACHELINE_SIZE)));
+	uint32_t ticket_next __attribute__((aligned(CACHELINE_SIZE)));
+	uint32_t ticket_owner __attribute__((aligned(CACHELINE_SIZE)));
+	uint32_t mcs_tail __attribute__((aligned(CACHELINE_SIZE)));
+	struct meter_mcs_node mcs[MAX_WORKERS];
+	struct meter_lock_stats stats[MAX_WORKERS];
+} meter_lock_t;
+
+int lock_parse(const char *, enum meter_lock_kind *);
+const char *lock_kind_name(enum meter_lock_kind);
+
+struct meter_lock *lock_create(const char *, enum meter_lock_kind, unsigned);
+void lock_reset(struct meter_lock *, long);
+uint64_t lock_acquire(struct meter_lock *, struct meter_worker_state *);
+void lock_release(struct meter_lock *, struct meter_worker_state *);
+void lock_report(struct meter_settings *);
+
+#endif /* !_LOCK_H_ */
@@ -9,6 +9,7 @@
 
 #include <sys/param.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/wait.h>
@@ -16,19 +17,31 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <sched.h>
 #include <semaphore.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "affinity.h"
+#include "lock.h"
 #include "progress.h"
+#include "report.h"
 #include "syscallmeter.h"
 #include "w_clock_gettime.h"
+#include "w_mmap.h"
+#include "w_null.h"
 #include "w_open.h"
+#include "w_pathwalk.h"
+#include "w_read.h"
+#include "w_readdir.h"
 #include "w_rename.h"
+#include "w_stat.h"
 #include "w_write_sync.h"
 #include "w_write_unlink.h"
 
@@ -50,7 +63,22 @@ const struct meter_settings default_settings = { .cpu_limit = CPULIMIT_DEF,
 	.mode = MODE_DEF,
 	.options = NULL,
 	.ncpu = 0,
-	.progress = 0 };
+	.progress = 0,
+	.ns_per_tick = 1.0,
+	.placement = NULL,
+	.threads = 0,
+	.duration = 0,
+	.warmup = 0,
+	.format = FORMAT_TEXT,
+	.sweep_len = 0,
+	.parent_cpu = -1 };
+
+typedef struct meter_worker_arg {
+	struct meter_ctx *ctx;
+	worker_func *func;
+	long id;
+	int dirfd;
+} meter_worker_arg_t;
 
 /* Context functions */
 static struct meter_ctx *new_context();
@@ -58,17 +86,24 @@ static int init_directory(struct meter_ctx *mctx);
 static int parse_opts(struct meter_ctx *mctx, int argc, char **argv);
 static int lookup_test_callbacks(char *mode, worker_func *func);
 
+/* Worker functions */
+static int run_worker(struct meter_ctx *ctx, worker_func *func, long id,
+    int dirfd);
+static void *run_worker_thread(void *arg);
+static void run_phases(struct meter_ctx *ctx);
+static int run_step(struct meter_ctx *ctx, worker_func *func, int dirfd);
+
 int
 main(int argc, char **argv)
 {
 	struct meter_ctx *ctx;
 	int dirfd, err;
 
-	pid_t child;
 	worker_func func;
+	struct report_step steps[MAX_WORKERS];
 
 	const char delim[] = ",";
-	char *saveptr, *option;
+	char *saveptr, *option, *options;
 
 	ctx = new_context();
 	if (ctx == NULL)
@@ -89,10 +124,14 @@ main(int argc, char **argv)
 	printf("Created directory successfully\n");
 
 	err = lookup_test_callbacks(ctx->settings->mode, &func);
+	if (err != 0)
+		return -1;
 
 	// Parse options and push them
 	if (ctx->settings->options != NULL && func.opt != NULL) {
-		option = strtok_r(ctx->settings->options, delim, &saveptr);
+		/* Keep settings intact for the report */
+		options = strdup(ctx->settings->options);
+		option = strtok_r(options, delim, &saveptr);
 		while (option != NULL) {
 			err = func.opt(option);
 			if (err != 0) {
@@ -104,97 +143,443 @@ main(int argc, char **argv)
 
 	// Initialize test
 	err = func.init(ctx->settings, dirfd);
-	//ctx->settings->ncpu = ctx->settings->cpu_limit;
-	for (long i = 0; i < ctx->settings->ncpu; i++) {
-		child = fork();
-		if (child == 0) {
-			cpu_set_t mask;
-			double speed;
-			long iter;
-			struct meter_worker_state mystate;
-			struct timespec ts_start, ts_end;
-
-			mystate.my_stats = &(ctx->stats[i]);
-			mystate.settings = ctx->settings;
-			child = getpid();
-
-			CPU_ZERO(&mask);
-			CPU_SET(i, &mask);
-			//err = sched_setaffinity(0, sizeof(cpu_set_t), &mask);
-			if (err == -1) {
-				printf("[%d] Can\'t set affinity\n", child);
-				return -1;
-			}
-			printf("[%d] I\'m on CPU: %d\n", child, sched_getcpu());
-			sem_post(&(ctx->sems->fork_completed));
-			sem_wait(&(ctx->sems->starting));
-			clock_gettime(CLOCK_MONOTONIC, &ts_start);
-
-			iter = func.job(i, &mystate, dirfd);
+	if (err != 0) {
+		printf("Can\'t initialize test\n");
+		return -1;
+	}
+	ctx->settings->ns_per_tick = ticks_calibrate();
 
-			clock_gettime(CLOCK_MONOTONIC, &ts_end);
+	if (ctx->settings->parent_cpu >= 0 &&
+	    affinity_pin(ctx->settings->parent_cpu) == -1) {
+		printf("[main] Can\'t set affinity: %s\n", strerror(errno));
+		return -1;
+	}
 
-			ts_end.tv_sec = ts_end.tv_sec - ts_start.tv_sec;
-			ts_end.tv_nsec = ts_end.tv_nsec - ts_start.tv_nsec;
-			if (ts_end.tv_nsec < 0) {
-				ts_end.tv_nsec += 1000 * 1000 * 1000;
-				ts_end.tv_sec -= 1;
-			}
+	/* Measured on the CPU the parent stays on, not wherever it started */
+	if (ctx->settings->baseline) {
+		ctx->settings->baseline_ns = w_null_baseline(ctx->settings);
+		printf("Null syscall baseline: %.1f ns\n",
+		    ctx->settings->baseline_ns);
+	}
 
-			speed = (double)((long long)ts_end.tv_sec * 1000 *
-					1000 * 1000 +
-				    ts_end.tv_nsec) /
-			    (double)(iter);
+	if (ctx->settings->progress == 1)
+		enable_progress(ctx->stats, ctx->settings->ncpu);
 
-			printf(
-			    "[%ld / %d] Worker is done with %ld in %lld.%.9ld sec (avg.time = %f ns)\n",
-			    i, child, iter, (long long)ts_end.tv_sec,
-			    ts_end.tv_nsec, speed);
-			return 0;
-		}
+	if (ctx->settings->sweep_len == 0) {
+		if (run_step(ctx, &func, dirfd) != 0)
+			return -1;
+		report_results(ctx, ctx->out);
+		if (func.report != NULL)
+			func.report(ctx->settings);
+		lock_report(ctx->settings);
+		return 0;
 	}
 
-	// Hackish - TODO: cosmetic change is required
-	do {
-		cpu_set_t mask;
-		double speed;
-		long iter;
-
-		CPU_ZERO(&mask);
-		CPU_SET(ctx->settings->ncpu, &mask);
-		//err = sched_setaffinity(0, sizeof(cpu_set_t), &mask);
-		if (err == -1) {
-			printf("[main] Can\'t set affinity\n");
+	// Sweep: same dataset, one step per worker count
+	for (int i = 0; i < ctx->settings->sweep_len; i++) {
+		ctx->settings->ncpu = ctx->settings->sweep[i];
+		printf("Sweep step %d: %ld workers\n", i + 1,
+		    ctx->settings->ncpu);
+		if (run_step(ctx, &func, dirfd) != 0)
 			return -1;
+		report_collect_step(ctx, &steps[i]);
+		if (func.report != NULL)
+			func.report(ctx->settings);
+		lock_report(ctx->settings);
+	}
+	report_sweep(ctx, ctx->out, steps, ctx->settings->sweep_len);
+	return 0;
+}
+
+/*
+ * Launch settings->ncpu workers, release them at once and wait for all
+ * of them. Results are left in the shared stats region.
+ */
+static int
+run_step(struct meter_ctx *ctx, worker_func *func, int dirfd)
+{
+	pthread_t tids[MAX_WORKERS];
+	struct meter_worker_arg targs[MAX_WORKERS];
+	pid_t pids[MAX_WORKERS];
+	pid_t child;
+	int err;
+
+	memset(ctx->stats, 0, sizeof(struct meter_stats) * MAX_WORKERS);
+	ctx->control->phase = (ctx->settings->warmup > 0) ? METER_WARMUP :
+							     METER_MEASURE;
+	ctx->control->measure_ns = 0;
+	ctx->control->stop_ns = 0;
+
+	if (func->reset != NULL && func->reset(ctx->settings, dirfd) != 0) {
+		printf("Can\'t reset test\n");
+		return -1;
+	}
+
+	fflush(stdout);
+	for (long i = 0; i < ctx->settings->ncpu; i++) {
+		if (ctx->settings->threads) {
+			targs[i].ctx = ctx;
+			targs[i].func = func;
+			targs[i].id = i;
+			targs[i].dirfd = dirfd;
+			err = pthread_create(&tids[i], NULL, run_worker_thread,
+			    &targs[i]);
+			if (err != 0) {
+				printf("Can\'t create thread: %s\n",
+				    strerror(err));
+				return -1;
+			}
+			continue;
 		}
-	} while (1 == 0);
+
+		pids[i] = fork();
+		if (pids[i] == 0)
+			exit(run_worker(ctx, func, i, dirfd));
+	}
 
 	for (int i = 0; i < ctx->settings->ncpu; i++) {
 		sem_wait(&(ctx->sems->fork_completed));
 	}
 
-	if (ctx->settings->progress == 1)
-		enable_progress(ctx->stats, ctx->settings->ncpu);
-
 	printf("Starting...\n");
+	if (ctx->control->phase == METER_MEASURE)
+		ctx->control->measure_ns = meter_now_ns();
 	for (int i = 0; i < ctx->settings->ncpu; i++) {
 		sem_post(&(ctx->sems->starting));
 	}
 
+	if (ctx->settings->duration > 0)
+		run_phases(ctx);
+
+	for (long i = 0; i < ctx->settings->ncpu; i++) {
+		if (ctx->settings->threads)
+			pthread_join(tids[i], NULL);
+		else if (pids[i] > 0)
+			while (waitpid(pids[i], NULL, 0) == -1 && errno == EINTR)
+				;
+	}
+	if (func->finish != NULL)
+		func->finish(ctx->settings);
+	/* Helper processes a workload may have forked */
 	do {
-		child = wait(&child);
+		child = wait(NULL);
 	} while (child > 0 || (child == -1 && errno == EINTR));
+	meter_stop(ctx->control);
 
 	printf("Done\n");
+	fflush(stdout);
 	return 0;
 }
 
+/*
+ * Body of a worker, either a forked process or a thread (-T): pin, wait
+ * for the start barrier, run the job and account its wall time.
+ */
+static int
+run_worker(struct meter_ctx *ctx, worker_func *func, long id, int dirfd)
+{
+	double speed;
+	long iter;
+	pid_t self;
+	struct meter_worker_state mystate;
+	struct timespec ts_start, ts_end;
+
+	mystate.my_stats = &(ctx->stats[id]);
+	mystate.settings = ctx->settings;
+	mystate.control = ctx->control;
+	mystate.id = id;
+	mystate.op_lock_wait = 0;
+	mystate.op_lag = 0;
+	mystate.pace_next = 0;
+	mystate.pace_interval = 0;
+	mystate.measuring = 0;
+	mystate.opaque = NULL;
+	self = ctx->settings->threads ? gettid() : getpid();
+
+	if (ctx->settings->placement != NULL &&
+	    affinity_pin(ctx->settings->cpu_map[id]) == -1) {
+		printf("[%d] Can\'t set affinity: %s\n", self, strerror(errno));
+		sem_post(&(ctx->sems->fork_completed));
+		return -1;
+	}
+	printf("[%d] I\'m on CPU: %d\n", self, sched_getcpu());
+	sem_post(&(ctx->sems->fork_completed));
+	sem_wait(&(ctx->sems->starting));
+	clock_gettime(CLOCK_MONOTONIC, &ts_start);
+
+	/* Each worker takes ncpu / rate; start offsets spread the arrivals */
+	if (ctx->settings->rate > 0) {
+		mystate.pace_interval = (uint64_t)(ctx->settings->ncpu * 1e9 /
+		    ctx->settings->rate / ctx->settings->ns_per_tick);
+		mystate.pace_interval = MAX(mystate.pace_interval, 1);
+		mystate.pace_next = vi_tmGetTicks() +
+		    mystate.pace_interval * id / ctx->settings->ncpu;
+	}
+
+	iter = func->job(id, &mystate, dirfd);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts_end);
+
+	/* All workers must be active in the window, so the first one out ends it */
+	if (ctx->settings->duration > 0 && !meter_stopped(&mystate)) {
+		printf("[%ld / %d] Warning! Worker finished before the end of the run\n",
+		    id, self);
+		meter_stop(ctx->control);
+	}
+
+	ts_end.tv_sec = ts_end.tv_sec - ts_start.tv_sec;
+	ts_end.tv_nsec = ts_end.tv_nsec - ts_start.tv_nsec;
+	if (ts_end.tv_nsec < 0) {
+		ts_end.tv_nsec += 1000 * 1000 * 1000;
+		ts_end.tv_sec -= 1;
+	}
+	mystate.my_stats->elapsed_ns = (uint64_t)ts_end.tv_sec * 1000000000ULL +
+	    ts_end.tv_nsec;
+
+	speed = (double)((long long)ts_end.tv_sec * 1000 * 1000 * 1000 +
+		    ts_end.tv_nsec) /
+	    (double)(iter);
+
+	printf(
+	    "[%ld / %d] Worker is done with %ld in %lld.%.9ld sec (avg.time = %f ns)\n",
+	    id, self, iter, (long long)ts_end.tv_sec, ts_end.tv_nsec, speed);
+	return 0;
+}
+
+static void *
+run_worker_thread(void *arg)
+{
+	struct meter_worker_arg *warg = arg;
+	sigset_t set;
+
+	/* Progress timer signals belong to the main thread */
+	sigemptyset(&set);
+	sigaddset(&set, SIGRTMIN);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	run_worker(warg->ctx, warg->func, warg->id, warg->dirfd);
+	return (NULL);
+}
+
+uint64_t
+meter_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/* Close the measurement window, only the first call has effect */
+void
+meter_stop(struct meter_control *c)
+{
+	int phase = c->phase;
+
+	while (phase != METER_STOP) {
+		if (__atomic_compare_exchange_n(&c->phase, &phase, METER_STOP,
+			0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			c->stop_ns = meter_now_ns();
+			break;
+		}
+	}
+}
+
+/*
+ * Make room for workloads that keep per_worker descriptors open for the
+ * whole job. Threads share one descriptor table, processes do not. The
+ * soft RLIMIT_NOFILE is raised up to the hard one when needed.
+ */
+#define FDS_SPARE 64 /* stdio, dirfd, rings and whatever the job opens */
+
+int
+reserve_fds(struct meter_settings *s, long per_worker)
+{
+	struct rlimit rl;
+	rlim_t needed;
+
+	needed = per_worker * (s->threads ? s->ncpu : 1) + FDS_SPARE;
+	if (getrlimit(RLIMIT_NOFILE, &rl) != 0) {
+		printf("Can't get RLIMIT_NOFILE: %s\n", strerror(errno));
+		return -1;
+	}
+	if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < needed) {
+		if (rl.rlim_max != RLIM_INFINITY && rl.rlim_max < needed) {
+			printf("Need %lu open files, RLIMIT_NOFILE allows %lu: "
+			       "raise ulimit -n or lower -f\n",
+			    (unsigned long)needed, (unsigned long)rl.rlim_max);
+			return -1;
+		}
+		rl.rlim_cur = needed;
+		if (setrlimit(RLIMIT_NOFILE, &rl) != 0) {
+			printf("Can't raise RLIMIT_NOFILE to %lu: %s\n",
+			    (unsigned long)needed, strerror(errno));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Wait for the TSC to reach the scheduled tick. Long gaps are slept
+ * through in chunks short enough to notice the stop flag, the tail is
+ * spun so that the wakeup latency does not shift the schedule.
+ */
+#define PACE_SPIN_NS (50 * 1000)
+#define PACE_SLEEP_MAX_NS (10 * 1000 * 1000)
+
+void
+meter_pace_wait(struct meter_worker_state *s, uint64_t until)
+{
+	struct timespec ts = { .tv_sec = 0 };
+	uint64_t now;
+	double left_ns;
+
+	while ((now = vi_tmGetTicks()) < until) {
+		if (meter_stopped(s))
+			return;
+		left_ns = (until - now) * s->settings->ns_per_tick;
+		if (left_ns > 2 * PACE_SPIN_NS) {
+			ts.tv_nsec = MIN(left_ns - PACE_SPIN_NS,
+			    PACE_SLEEP_MAX_NS);
+			nanosleep(&ts, NULL);
+		} else {
+			__builtin_ia32_pause();
+		}
+	}
+}
+
+/* Sleep for the given number of seconds unless the run is stopped */
+static void
+sleep_phase(struct meter_control *c, long sec)
+{
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = 10 * 1000 * 1000 };
+	uint64_t deadline;
+
+	deadline = meter_now_ns() + (uint64_t)sec * 1000000000ULL;
+	while (c->phase != METER_STOP && meter_now_ns() < deadline)
+		nanosleep(&ts, NULL);
+}
+
+/*
+ * Drive duration bound runs (-t): warmup, measurement window, stop flag.
+ * Workers finishing early close the window on their own.
+ */
+static void
+run_phases(struct meter_ctx *ctx)
+{
+	struct meter_control *c = ctx->control;
+	int phase = METER_WARMUP;
+
+	if (ctx->settings->warmup > 0) {
+		sleep_phase(c, ctx->settings->warmup);
+		if (__atomic_compare_exchange_n(&c->phase, &phase,
+			METER_MEASURE, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+			c->measure_ns = meter_now_ns();
+	}
+
+	sleep_phase(c, ctx->settings->duration);
+	meter_stop(c);
+}
+
+/*
+ * Worker counts for --sweep: explicit list or "auto" for powers of two
+ * up to the number of workers, which is included as the last step.
+ */
+static int
+parse_sweep(struct meter_settings *s, char *arg)
+{
+	char *saveptr, *token, *end;
+	long count;
+
+	s->sweep_len = 0;
+	if (strcmp(arg, "auto") == 0) {
+		for (count = 1; count < s->ncpu; count *= 2)
+			s->sweep[s->sweep_len++] = count;
+		s->sweep[s->sweep_len++] = s->ncpu;
+		return (0);
+	}
+
+	for (token = strtok_r(arg, ",", &saveptr); token != NULL;
+	     token = strtok_r(NULL, ",", &saveptr)) {
+		count = strtol(token, &end, 10);
+		if (*end != '\0' || count <= 0 || count > s->ncpu ||
+		    s->sweep_len == MAX_WORKERS) {
+			printf(
+			    "invalid step %s for option --sweep expected integer from 1 to %ld\n",
+			    token, s->ncpu);
+			return -1;
+		}
+		s->sweep[s->sweep_len++] = count;
+	}
+
+	if (s->sweep_len == 0) {
+		printf("option --sweep expects worker counts\n");
+		return -1;
+	}
+	return (0);
+}
+
 static int
 parse_opts(struct meter_ctx *mctx, int argc, char **argv)
 {
-	int opt;
-	while ((opt = getopt(argc, argv, "j:c:f:s:d:m:o:hp")) != -1) {
+	enum { OPT_FORMAT = 256, OPT_SWEEP, OPT_RATE, OPT_DATA, OPT_BASELINE };
+	static const struct option long_opts[] = {
+		{ "format", required_argument, NULL, OPT_FORMAT },
+		{ "sweep", required_argument, NULL, OPT_SWEEP },
+		{ "rate", required_argument, NULL, OPT_RATE },
+		{ "data", required_argument, NULL, OPT_DATA },
+		{ "baseline", no_argument, NULL, OPT_BASELINE },
+		{ NULL, 0, NULL, 0 }
+	};
+	int opt, fd;
+	char *sweep = NULL;
+	char data[32];
+
+	while ((opt = getopt_long(argc, argv, "a:j:c:f:s:d:m:o:t:w:hpT",
+		    long_opts, NULL)) != -1) {
 		switch (opt) {
+		case OPT_FORMAT:
+			if (strcmp(optarg, "text") == 0) {
+				mctx->settings->format = FORMAT_TEXT;
+			} else if (strcmp(optarg, "json") == 0) {
+				mctx->settings->format = FORMAT_JSON;
+			} else if (strcmp(optarg, "csv") == 0) {
+				mctx->settings->format = FORMAT_CSV;
+			} else {
+				printf(
+				    "invalid arg %s for option --format expected text, json or csv\n",
+				    optarg);
+				return -1;
+			}
+			break;
+		case OPT_SWEEP:
+			sweep = optarg;
+			break;
+		case OPT_RATE:
+			errno = 0;
+			mctx->settings->rate = strtod(optarg, NULL);
+			if (errno == ERANGE || !(mctx->settings->rate > 0)) {
+				printf(
+				    "invalid arg %s for option --rate expected ops/s grater than 0\n",
+				    optarg);
+				return -1;
+			}
+			break;
+		case OPT_DATA:
+			if (datagen_parse(&mctx->settings->data, optarg) != 0) {
+				printf(
+				    "invalid arg %s for option --data expected random, zero, text or ratio=0..1\n",
+				    optarg);
+				return -1;
+			}
+			break;
+		case OPT_BASELINE:
+			mctx->settings->baseline = 1;
+			break;
+		case 'a':
+			mctx->settings->placement = optarg;
+			break;
 		case 'j':
 			mctx->settings->cpu_limit = strtol(optarg, NULL, 10);
 			if (errno == EINVAL || errno == ERANGE ||
@@ -236,6 +621,26 @@ parse_opts(struct meter_ctx *mctx, int argc, char **argv)
 				return -1;
 			}
 			break;
+		case 't':
+			mctx->settings->duration = strtol(optarg, NULL, 10);
+			if (errno == EINVAL || errno == ERANGE ||
+			    mctx->settings->duration <= 0) {
+				printf(
+				    "invalid arg %s for option -t expected integer grater than 0\n",
+				    optarg);
+				return -1;
+			}
+			break;
+		case 'w':
+			mctx->settings->warmup = strtol(optarg, NULL, 10);
+			if (errno == EINVAL || errno == ERANGE ||
+			    mctx->settings->warmup <= 0) {
+				printf(
+				    "invalid arg %s for option -w expected integer grater than 0\n",
+				    optarg);
+				return -1;
+			}
+			break;
 		case 'd':
 			mctx->settings->temp_dir = optarg;
 			break;
@@ -248,16 +653,40 @@ parse_opts(struct meter_ctx *mctx, int argc, char **argv)
 		case 'p':
 			mctx->settings->progress = 1;
 			break;
+		case 'T':
+			mctx->settings->threads = 1;
+			break;
 		case 'h':
 			printf(
 			    "Usage:\n"
+			    " -a worker placement: compact, scatter, core or CPU list (e.g. 0-3,8), default none\n"
 			    " -c number of cycles, default %d\n"
 			    " -d directory path, default %s\n"
 			    " -f number of files to create, default %d\n"
 			    " -h no arg, use to dispay this message\n"
 			    " -j number of max number of cpu, default %d\n"
-			    " -m defines worker job, valid jobs: open, rename, write_unlink. Default %s\n"
-			    " -s number of bytes in each file, default %d\n",
+			    " -m defines worker job, valid jobs: open, rename, write_unlink, write_sync, stat, readdir, mmap, read, pathwalk, null, clock_gettime. Default %s\n"
+			    " -o comma separated job options, e.g. open: sync, uring, qd=N, fixed, sqpoll\n"
+			    "    rename: plain, noreplace, exchange, overwrite, shared, perworker, crossdir\n"
+			    "    stat: fstatat, statx, fstat, mask=type|size|basic|btime|all|N, dontsync, forcesync, negative\n"
+			    "    readdir: entries=N, buf=N, churn=N\n"
+			    "    mmap: file, anon, stride=N, shared, private, populate, dontneed, huge, hugetlb, write\n"
+			    "    pathwalk: rel, abs, depth=N, symlinks=N, beneath, nosymlinks, cached, opath\n"
+			    "    null: getpid, getppid, invalid, vdso, vdsosys, batch=N\n"
+			    "    read: pread, preadv, uring, bs=N, iov=N, qd=N, direct, seq, rand\n"
+			    "    write_sync: joined, dual, onlywrite, sharesync8, sharesync16, uring, groupcommit, syncer, syncdelay=USEC, recycle, append, fallocate, zero, preopen,\n"
+			    "        fdatasync, fsync, odsync, rwfdsync, syncrange, lock=sem|futex|ticket|mcs, qd=N, direct, doublelast\n"
+			    " -p no arg, print progress every second\n"
+			    " -s number of bytes in each file, default %d\n"
+			    " -t run duration in seconds instead of cycles\n"
+			    " -T no arg, run workers as threads of one process instead of forked processes\n"
+			    " -w warmup in seconds excluded from results, requires -t\n"
+			    " --format text, json or csv result output, default text; json and csv carry per-worker\n"
+			    "          and overall results, phase and lock statistics stay text on stderr\n"
+			    " --sweep worker counts to run one after another, e.g. 1,2,4,8 or auto\n"
+			    " --rate total ops/s issued on a fixed schedule, latency counts from the intended start\n"
+			    " --data written payload: random, zero, text or ratio=X compressing to X of its size, default random\n"
+			    " --baseline measure the null syscall cost first and report latency net of it too\n",
 			    CYCLES_DEF, TEMPDIR_DEF, FILECOUNT_DEF,
 			    CPULIMIT_DEF, MODE_DEF, FILESIZE_DEF);
 			return -1;
@@ -267,60 +696,257 @@ parse_opts(struct meter_ctx *mctx, int argc, char **argv)
 		}
 	}
 
+	/*
+	 * Structured output owns stdout: everything else printed along the
+	 * run goes to stderr, including the phase and lock reports.
+	 */
+	mctx->out = stdout;
+	if (mctx->settings->format != FORMAT_TEXT) {
+		fd = dup(STDOUT_FILENO);
+		if (fd < 0 || (mctx->out = fdopen(fd, "w")) == NULL ||
+		    dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+			printf("Can't redirect output: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	if (mctx->settings->warmup > 0 && mctx->settings->duration == 0) {
+		printf("option -w requires -t\n");
+		return -1;
+	}
+
 	mctx->settings->ncpu = sysconf(_SC_NPROCESSORS_ONLN);
 	printf("Found %ld cores\n", mctx->settings->ncpu);
 	mctx->settings->ncpu = MIN(mctx->settings->ncpu - 1,
 	    mctx->settings->cpu_limit);
 	mctx->settings->ncpu = MIN(MAX_WORKERS, mctx->settings->ncpu);
 
+	if (affinity_init(mctx->settings) != 0)
+		return -1;
+
+	if (sweep != NULL && parse_sweep(mctx->settings, sweep) != 0)
+		return -1;
+
 	printf("Settings:\n");
-	printf("\tCYCLES = %ld\n", mctx->settings->cycles);
-	printf("\tWORKERS = %ld\n", mctx->settings->ncpu);
+	if (mctx->settings->duration > 0)
+		printf("\tDURATION = %ld s (warmup %ld s)\n",
+		    mctx->settings->duration, mctx->settings->warmup);
+	else
+		printf("\tCYCLES = %ld\n", mctx->settings->cycles);
+	printf("\tWORKERS = %ld (%s)\n", mctx->settings->ncpu,
+	    mctx->settings->threads ? "threads" : "processes");
+	if (mctx->settings->rate > 0)
+		printf("\tRATE = %.0f ops/s\n", mctx->settings->rate);
 	printf("\tFILECOUNT = %d\n", mctx->settings->file_count);
 	printf("\tFILESIZE = %d\n", mctx->settings->file_size);
+	datagen_name(&mctx->settings->data, data, sizeof(data));
+	printf("\tDATA = %s\n", data);
 
 	return 0;
 }
 
-int
-make_files(struct meter_settings *s, int dirfd)
+/*
+ * Dataset manifest kept in -d next to the files. It describes the files
+ * the last setup completed, so that a later run with the same -f and -s
+ * only recreates the files a workload has removed or resized.
+ */
+#define MANIFEST_NAME ".syscallmeter_dataset"
+#define MAKE_FILES_CHUNK (8 * 1024 * 1024)
+
+static void
+manifest_format(struct meter_settings *s, char *buf, size_t len)
+{
+	char data[32];
+
+	datagen_name(&s->data, data, sizeof(data));
+	snprintf(buf, len,
+	    "syscallmeter dataset 2\nfile_count %d\nfile_size %lu\ndata %s\n",
+	    s->file_count, s->file_size, data);
+}
+
+static int
+manifest_matches(struct meter_settings *s, int dirfd)
+{
+	char want[256], have[256];
+	ssize_t len;
+	int fd;
+
+	fd = openat(dirfd, MANIFEST_NAME, O_RDONLY);
+	if (fd < 0)
+		return (0);
+	len = read(fd, have, sizeof(have) - 1);
+	close(fd);
+	if (len < 0)
+		return (0);
+	have[len] = '\0';
+
+	manifest_format(s, want, sizeof(want));
+	return (strcmp(want, have) == 0);
+}
+
+static int
+manifest_write(struct meter_settings *s, int dirfd)
+{
+	char buf[256];
+	size_t len;
+	int fd;
+
+	manifest_format(s, buf, sizeof(buf));
+	len = strlen(buf);
+	fd = openat(dirfd, MANIFEST_NAME, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0 || write(fd, buf, len) != (ssize_t)len) {
+		printf("Can't write dataset manifest: %s\n", strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+/*
+ * Create one file of the dataset, data has room for MIN(file_size, chunk)
+ * bytes. Every chunk is generated with a seed of its own, so that files
+ * larger than a chunk do not repeat themselves.
+ */
+static int
+make_file(struct meter_settings *s, int dirfd, int k, char *data,
+    size_t chunk)
 {
-	char *rndbytes;
 	char filename[128];
+	size_t done, n;
+	ssize_t written;
+	uint64_t seed;
 	int fd;
-	size_t written;
 
-	rndbytes = alloc_rndbytes(s->file_size);
-	if (rndbytes == NULL) {
-		printf("Can\'t allocate random bytes");
+	sprintf(filename, FNAME, k);
+	fd = openat(dirfd, filename, O_CREAT | O_TRUNC | O_RDWR, 0644);
+	if (fd < 0) {
+		printf("Can't create or open file %s: %s\n", filename,
+		    strerror(errno));
 		return -1;
 	}
 
-	for (int k = 0; k < s->file_count; k++) {
-		sprintf(filename, FNAME, k);
-		fd = openat(dirfd, filename, O_CREAT | O_TRUNC | O_RDWR, 0644);
-		if (fd < 0) {
-			printf("Can't create or open file %s", filename);
-			return -1;
-		}
-		written = write(fd, rndbytes, s->file_size);
-		if (written == -1) {
+	/* Best effort: lets the filesystem allocate the file in one extent */
+	if (s->file_size > 0)
+		(void)fallocate(fd, 0, 0, s->file_size);
+
+	for (done = 0; done < s->file_size; done += written) {
+		/* Distinct content per file and offset, nothing for dedup */
+		seed = (uint64_t)(done / chunk) * s->file_count + k;
+		n = MIN(chunk, s->file_size - done);
+		datagen_fill(&s->data, data, n, seed);
+		written = write(fd, data, n);
+		if (written <= 0) {
 			printf("Can't write file %s: %s\n", filename,
-			    strerror(errno));
-			return -1;
-		} else if (written != s->file_size) {
-			printf("Can't fully write file %s: %zu\n", filename,
-			    written);
+			    written < 0 ? strerror(errno) : "short write");
+			close(fd);
 			return -1;
 		}
+	}
+
+	close(fd);
+	return 0;
+}
+
+static int
+file_is_current(struct meter_settings *s, int dirfd, int k)
+{
+	char filename[128];
+	struct stat st;
+
+	sprintf(filename, FNAME, k);
+	return (fstatat(dirfd, filename, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+	    S_ISREG(st.st_mode) && st.st_size == (off_t)s->file_size);
+}
 
-		close(fd);
+/* Shard 'shard' of 'nshards' creates every file k with k % nshards == shard */
+static int
+make_files_shard(struct meter_settings *s, int dirfd, int shard, int nshards,
+    int reuse)
+{
+	char *data;
+	size_t chunk;
+
+	chunk = MAX(MIN(s->file_size, MAKE_FILES_CHUNK), 1);
+	data = malloc(chunk);
+	if (data == NULL) {
+		printf("Can\'t allocate file data\n");
+		return -1;
 	}
 
-	free(rndbytes);
+	for (int k = shard; k < s->file_count; k += nshards) {
+		if (reuse && file_is_current(s, dirfd, k))
+			continue;
+		if (make_file(s, dirfd, k, data, chunk) != 0) {
+			free(data);
+			return -1;
+		}
+	}
+
+	free(data);
+	return 0;
+}
+
+/*
+ * A workload about to change the files in place drops the manifest, so
+ * that the next make_files() creates the dataset anew.
+ */
+int
+make_files_forget(int dirfd)
+{
+	if (unlinkat(dirfd, MANIFEST_NAME, 0) != 0 && errno != ENOENT) {
+		printf("Can't remove dataset manifest: %s\n", strerror(errno));
+		return -1;
+	}
 	return 0;
 }
 
+/*
+ * Create the dataset with one forked process per worker, each one taking
+ * its own shard of the files. A dataset left by a previous run with the
+ * same geometry is reused, only missing or resized files are recreated.
+ */
+int
+make_files(struct meter_settings *s, int dirfd)
+{
+	int nshards, reuse, status, err = 0;
+	pid_t pids[MAX_WORKERS];
+
+	reuse = manifest_matches(s, dirfd);
+	if (reuse) {
+		printf("Found dataset of %d files of %lu bytes, reusing it\n",
+		    s->file_count, s->file_size);
+	} else if (make_files_forget(dirfd) != 0) {
+		return -1;
+	}
+
+	nshards = MAX(MIN(s->ncpu, s->file_count), 1);
+	fflush(stdout);
+	for (int i = 0; i < nshards; i++) {
+		pids[i] = fork();
+		if (pids[i] == -1) {
+			printf("Can't fork dataset shard: %s\n", strerror(errno));
+			nshards = i;
+			err = -1;
+			break;
+		}
+		if (pids[i] == 0)
+			exit(make_files_shard(s, dirfd, i, nshards, reuse) ?
+				1 : 0);
+	}
+
+	for (int i = 0; i < nshards; i++) {
+		if (waitpid(pids[i], &status, 0) == -1 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status) != 0)
+			err = -1;
+	}
+	if (err != 0)
+		return -1;
+
+	return manifest_write(s, dirfd);
+}
+
 static int
 init_directory(struct meter_ctx *mctx)
 {
@@ -351,26 +977,6 @@ init_directory(struct meter_ctx *mctx)
 	return 0;
 }
 
-char *
-alloc_rndbytes(size_t size)
-{
-	char *ret;
-	unsigned int g_seed;
-	g_seed = random();
-
-	ret = malloc(size);
-	if (ret == NULL) {
-		return ret;
-	}
-
-	for (int i = 0; i < size; i++) {
-		g_seed = (214013 * g_seed + 2531011);
-		ret[i] = 'A' + (char)(((g_seed >> 16) & 0x7FFF) % 0x1a);
-	}
-
-	return ret;
-}
-
 static struct meter_ctx *
 new_context()
 {
@@ -408,10 +1014,19 @@ new_context()
 		goto free_settings;
 	}
 
-	for (int i = 0; i < MAX_WORKERS; i++) {
-		ctx->stats[i].cycles = 0;
+	memset(ctx->stats, 0, sizeof(struct meter_stats) * MAX_WORKERS);
+
+	ctx->control = mmap(0, sizeof(struct meter_control),
+	    PROT_READ | PROT_WRITE, MAP_ANON | MAP_SHARED, -1, 0);
+
+	if (ctx->control == MAP_FAILED) {
+		printf("Can't mmap area: %s\n", strerror(errno));
+		goto free_settings;
 	}
 
+	memset(ctx->control, 0, sizeof(struct meter_control));
+	ctx->control->phase = METER_MEASURE;
+
 	return (ctx);
 
 free_sems:
@@ -427,14 +1042,16 @@ fail:
 static int
 lookup_test_callbacks(char *mode, worker_func *func)
 {
+	memset(func, 0, sizeof(worker_func));
 	if (strcmp(mode, "open") == 0) {
 		func->init = &w_open_init;
 		func->job = &w_open_job;
-		func->opt = NULL;
+		func->opt = &w_open_option;
 	} else if (strcmp(mode, "rename") == 0) {
 		func->init = &w_rename_init;
 		func->job = &w_rename_job;
-		func->opt = NULL;
+		func->opt = &w_rename_option;
+		func->reset = &w_rename_reset;
 	} else if (strcmp(mode, "write_unlink") == 0) {
 		func->init = &w_write_unlink_init;
 		func->job = &w_write_unlink_job;
@@ -443,6 +1060,35 @@ lookup_test_callbacks(char *mode, worker_func *func)
 		func->init = &w_write_sync_init;
 		func->job = &w_write_sync_job;
 		func->opt = &w_write_sync_option;
+		func->reset = &w_write_sync_reset;
+		func->finish = &w_write_sync_finish;
+		func->report = &w_write_sync_report;
+	} else if (strcmp(mode, "stat") == 0) {
+		func->init = &w_stat_init;
+		func->job = &w_stat_job;
+		func->opt = &w_stat_option;
+	} else if (strcmp(mode, "readdir") == 0) {
+		func->init = &w_readdir_init;
+		func->job = &w_readdir_job;
+		func->opt = &w_readdir_option;
+		func->reset = &w_readdir_reset;
+	} else if (strcmp(mode, "mmap") == 0) {
+		func->init = &w_mmap_init;
+		func->job = &w_mmap_job;
+		func->opt = &w_mmap_option;
+	} else if (strcmp(mode, "read") == 0) {
+		func->init = &w_read_init;
+		func->job = &w_read_job;
+		func->opt = &w_read_option;
+	} else if (strcmp(mode, "pathwalk") == 0) {
+		func->init = &w_pathwalk_init;
+		func->job = &w_pathwalk_job;
+		func->opt = &w_pathwalk_option;
+	} else if (strcmp(mode, "null") == 0) {
+		func->init = &w_null_init;
+		func->job = &w_null_job;
+		func->opt = &w_null_option;
+		func->report = &w_null_report;
 	} else if (strcmp(mode, "clock_gettime") == 0) {
 		func->init = &w_clock_gettime_init;
 		func->job = &w_clock_gettime_job;
@@ -11,11 +11,12 @@ timer_handler(int sig, siginfo_t *si, void *uc)
 	static struct meter_stats *stats = NULL;
 	static long count = 0;
 	static long prev = 0;
+	static long prev_bytes = 0;
 
 	struct timespec ts;
 	struct timespec ts2;
 
-	long total;
+	long total, bytes;
 
 	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
 
@@ -28,9 +29,11 @@ timer_handler(int sig, siginfo_t *si, void *uc)
 	}
 
 	total = 0;
+	bytes = 0;
 	if (stats != NULL && count > 0) {
 		for (int i = 0; i < count; i++) {
-			total += stats[i].cycles;
+			total += stats[i].ops;
+			bytes += stats[i].bytes;
 		}
 	} else {
 		total = -1;
@@ -38,10 +41,16 @@ timer_handler(int sig, siginfo_t *si, void *uc)
 
 	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts2);
 
-	printf("[%ld.%09ld] ops = %ld\n", ts.tv_sec, ts.tv_nsec,
-	    (total - prev));
+	if (bytes > 0)
+		printf("[%ld.%09ld] ops = %ld, MB = %.1f\n", ts.tv_sec,
+		    ts.tv_nsec, (total - prev),
+		    (double)(bytes - prev_bytes) / (1024 * 1024));
+	else
+		printf("[%ld.%09ld] ops = %ld\n", ts.tv_sec, ts.tv_nsec,
+		    (total - prev));
 
 	prev = total;
+	prev_bytes = bytes;
 }
 
 int
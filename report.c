@@ -0,0 +1,622 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "report.h"
+#include "syscallmeter.h"
+#include "sysinfo.h"
+
+/* Results of a worker (or of all of them) ready to be printed */
+typedef struct report_row {
+	char label[32];
+	long id; /* -1 for the overall row */
+	int cpu; /* -1 when not pinned */
+	long ops;
+	long bytes;
+	long items;
+	long errors;
+	double ops_rate;
+	double mb_rate;
+	double items_rate;
+	double lock_wait_ns;
+	double syscall_ns;
+	uint64_t elapsed_ns;
+	uint64_t samples;
+	double avg, p50, p90, p99, p999, max; /* Latency in ns */
+} report_row_t;
+
+typedef struct report_meta {
+	char kernel[512];
+	char cpu_model[256];
+	char fs_type[64];
+	char mitigations[2048];
+	uint64_t window_ns;
+} report_meta_t;
+
+static void
+fill_latency(struct report_row *row, const struct meter_histo *h, double ns)
+{
+	row->samples = h->count;
+	if (h->count == 0)
+		return;
+
+	row->avg = ns * (double)h->sum / (double)h->count;
+	row->p50 = ns * histo_percentile(h, 50.0);
+	row->p90 = ns * histo_percentile(h, 90.0);
+	row->p99 = ns * histo_percentile(h, 99.0);
+	row->p999 = ns * histo_percentile(h, 99.9);
+	row->max = ns * h->max;
+}
+
+/*
+ * Per-worker rows plus the overall one in rows[ncpu]. For duration bound
+ * runs rates are taken over the measurement window, when all workers
+ * were active. For iteration bound ones every worker uses its own wall
+ * time and overall rates are the sum of per-worker rates.
+ */
+static struct report_row *
+build_rows(struct meter_ctx *ctx, uint64_t window_ns)
+{
+	struct meter_settings *s = ctx->settings;
+	struct report_row *rows, *all;
+	struct meter_histo *total;
+	uint64_t elapsed_ns;
+
+	rows = calloc(s->ncpu + 1, sizeof(struct report_row));
+	total = calloc(1, sizeof(struct meter_histo));
+	if (rows == NULL || total == NULL) {
+		free(rows);
+		free(total);
+		return (NULL);
+	}
+
+	all = &rows[s->ncpu];
+	snprintf(all->label, sizeof(all->label), "[all]");
+	all->id = -1;
+	all->cpu = -1;
+
+	for (long i = 0; i < s->ncpu; i++) {
+		struct meter_stats *st = &ctx->stats[i];
+		struct report_row *row = &rows[i];
+
+		row->id = i;
+		row->cpu = s->placement != NULL ? s->cpu_map[i] : -1;
+		/* Show placement as [worker@cpu] */
+		if (row->cpu >= 0)
+			snprintf(row->label, sizeof(row->label), "[%ld@%d]", i,
+			    row->cpu);
+		else
+			snprintf(row->label, sizeof(row->label), "[%ld]", i);
+
+		row->ops = st->ops;
+		row->bytes = st->bytes;
+		row->items = st->items;
+		row->errors = st->errors;
+		row->lock_wait_ns = s->ns_per_tick * st->lock_wait;
+		row->syscall_ns = s->ns_per_tick * st->syscall_time;
+		row->elapsed_ns = st->elapsed_ns;
+
+		elapsed_ns = s->duration > 0 ? window_ns : st->elapsed_ns;
+		if (elapsed_ns > 0) {
+			row->ops_rate = (double)st->ops * 1e9 / elapsed_ns;
+			row->mb_rate = (double)st->bytes * 1e9 / elapsed_ns /
+			    (1024 * 1024);
+			row->items_rate = (double)st->items * 1e9 / elapsed_ns;
+		}
+		fill_latency(row, &st->latency, s->ns_per_tick);
+
+		all->ops += row->ops;
+		all->bytes += row->bytes;
+		all->items += row->items;
+		all->errors += row->errors;
+		all->lock_wait_ns += row->lock_wait_ns;
+		all->syscall_ns += row->syscall_ns;
+		all->ops_rate += row->ops_rate;
+		all->mb_rate += row->mb_rate;
+		all->items_rate += row->items_rate;
+		all->elapsed_ns = MAX(all->elapsed_ns, row->elapsed_ns);
+		histo_merge(total, &st->latency);
+	}
+	fill_latency(all, total, s->ns_per_tick);
+
+	free(total);
+	return (rows);
+}
+
+static void
+print_counters(FILE *out, const struct report_row *row)
+{
+	double busy;
+
+	busy = row->lock_wait_ns + row->syscall_ns;
+	fprintf(out, "%-8s %12ld %12.0f %10.1f %8ld %9.1f%% %9.1f%%\n",
+	    row->label, row->ops, row->ops_rate, row->mb_rate, row->errors,
+	    busy > 0 ? 100.0 * row->lock_wait_ns / busy : 0.0,
+	    busy > 0 ? 100.0 * row->syscall_ns / busy : 0.0);
+}
+
+static void
+print_latency(FILE *out, const struct report_row *row)
+{
+	const char *label = row->label;
+
+	if (row->samples == 0) {
+		fprintf(out, "%-8s %12d %10s %10s %10s %10s %10s %10s\n", label,
+		    0, "-", "-", "-", "-", "-", "-");
+		return;
+	}
+
+	fprintf(out, "%-8s %12lu %10.0f %10.0f %10.0f %10.0f %10.0f %10.0f\n",
+	    label, row->samples, row->avg, row->p50, row->p90, row->p99,
+	    row->p999, row->max);
+}
+
+/*
+ * Take the kernel entry cost off every latency figure of the row. It is
+ * subtracted once per operation, even when the operation is made of
+ * several syscalls (open + close for pathwalk, write + sync for
+ * write_sync), so such figures still include the remaining entries.
+ */
+static void
+net_latency(struct report_row *row, double baseline)
+{
+	row->avg = MAX(row->avg - baseline, 0);
+	row->p50 = MAX(row->p50 - baseline, 0);
+	row->p90 = MAX(row->p90 - baseline, 0);
+	row->p99 = MAX(row->p99 - baseline, 0);
+	row->p999 = MAX(row->p999 - baseline, 0);
+	row->max = MAX(row->max - baseline, 0);
+}
+
+static void
+report_text(FILE *out, struct meter_ctx *ctx, struct report_row *rows,
+    struct report_meta *meta)
+{
+	long n = ctx->settings->ncpu;
+
+	if (ctx->settings->rate > 0)
+		fprintf(out, "Target rate %.0f ops/s, latency from intended start\n",
+		    ctx->settings->rate);
+	if (ctx->settings->duration > 0)
+		fprintf(out, "Throughput (measured window %.3f s):\n",
+		    (double)meta->window_ns / 1e9);
+	else
+		fprintf(out, "Throughput:\n");
+	fprintf(out, "%-8s %12s %12s %10s %8s %10s %10s\n", "worker", "ops",
+	    "ops/s", "MB/s", "errors", "lock wait", "syscall");
+	for (long i = 0; i <= n; i++)
+		print_counters(out, &rows[i]);
+
+	/* Only workloads with units other than operations count items */
+	if (rows[n].items > 0) {
+		fprintf(out, "Items:\n");
+		fprintf(out, "%-8s %12s %12s %12s\n", "worker", "items",
+		    "items/s", "items/op");
+		for (long i = 0; i <= n; i++)
+			fprintf(out, "%-8s %12ld %12.0f %12.1f\n",
+			    rows[i].label, rows[i].items, rows[i].items_rate,
+			    rows[i].ops > 0 ?
+				(double)rows[i].items / rows[i].ops :
+				0.0);
+	}
+
+	fprintf(out, "Latency (ns):\n");
+	fprintf(out, "%-8s %12s %10s %10s %10s %10s %10s %10s\n", "worker",
+	    "ops", "avg", "p50", "p90", "p99", "p99.9", "max");
+	for (long i = 0; i <= n; i++)
+		print_latency(out, &rows[i]);
+
+	if (ctx->settings->baseline_ns > 0) {
+		fprintf(out,
+		    "Latency net of %.1f ns syscall baseline, once per op (ns):\n",
+		    ctx->settings->baseline_ns);
+		fprintf(out, "%-8s %12s %10s %10s %10s %10s %10s %10s\n",
+		    "worker", "ops", "avg", "p50", "p90", "p99", "p99.9",
+		    "max");
+		for (long i = 0; i <= n; i++) {
+			net_latency(&rows[i], ctx->settings->baseline_ns);
+			print_latency(out, &rows[i]);
+		}
+	}
+}
+
+static void
+json_string(FILE *out, const char *str)
+{
+	if (str == NULL) {
+		fprintf(out, "null");
+		return;
+	}
+
+	fputc('"', out);
+	for (const char *p = str; *p != '\0'; p++) {
+		if (*p == '"' || *p == '\\')
+			fprintf(out, "\\%c", *p);
+		else if ((unsigned char)*p < 0x20)
+			fprintf(out, "\\u%04x", (unsigned char)*p);
+		else
+			fputc(*p, out);
+	}
+	fputc('"', out);
+}
+
+static void
+json_latency(FILE *out, const char *name, const struct report_row *row)
+{
+	fprintf(out,
+	    "\"%s\": {\"samples\": %lu, \"avg\": %.1f, \"p50\": %.0f, "
+	    "\"p90\": %.0f, \"p99\": %.0f, \"p99.9\": %.0f, \"max\": %.0f}",
+	    name, row->samples, row->avg, row->p50, row->p90, row->p99,
+	    row->p999, row->max);
+}
+
+/* With --baseline latency is followed by the same figures net of it */
+static void
+json_row(FILE *out, const struct report_row *row, double baseline)
+{
+	struct report_row net;
+
+	fprintf(out, "{");
+	if (row->id >= 0)
+		fprintf(out, "\"id\": %ld, \"cpu\": %d, ", row->id, row->cpu);
+	fprintf(out,
+	    "\"ops\": %ld, \"bytes\": %ld, \"items\": %ld, \"errors\": %ld, "
+	    "\"elapsed_ns\": %lu, \"ops_per_sec\": %.3f, "
+	    "\"mb_per_sec\": %.3f, \"items_per_sec\": %.3f, "
+	    "\"lock_wait_ns\": %.0f, \"syscall_ns\": %.0f, ",
+	    row->ops, row->bytes, row->items, row->errors, row->elapsed_ns,
+	    row->ops_rate, row->mb_rate, row->items_rate, row->lock_wait_ns,
+	    row->syscall_ns);
+	json_latency(out, "latency_ns", row);
+	if (baseline > 0) {
+		net = *row;
+		net_latency(&net, baseline);
+		fprintf(out, ", ");
+		json_latency(out, "net_latency_ns", &net);
+	}
+	fprintf(out, "}");
+}
+
+/* Opens the document with settings and system sections */
+static void
+json_header(FILE *out, struct meter_ctx *ctx, struct report_meta *meta)
+{
+	struct meter_settings *s = ctx->settings;
+	char data[32];
+
+	fprintf(out, "{\n  \"settings\": {\"mode\": ");
+	json_string(out, s->mode);
+	fprintf(out, ", \"options\": ");
+	json_string(out, s->options);
+	fprintf(out,
+	    ", \"workers\": %ld, \"execution\": \"%s\", \"cycles\": %ld, "
+	    "\"duration_s\": %ld, \"warmup_s\": %ld, \"file_count\": %d, "
+	    "\"file_size\": %lu, \"rate\": %.3f, \"baseline_ns\": %.1f, "
+	    "\"directory\": ",
+	    s->ncpu, s->threads ? "threads" : "processes", s->cycles,
+	    s->duration, s->warmup, s->file_count, s->file_size, s->rate,
+	    s->baseline_ns);
+	json_string(out, s->temp_dir);
+	fprintf(out, ", \"placement\": ");
+	json_string(out, s->placement);
+	datagen_name(&s->data, data, sizeof(data));
+	fprintf(out, ", \"data\": ");
+	json_string(out, data);
+	fprintf(out, "},\n  \"system\": {\"kernel\": ");
+	json_string(out, meta->kernel);
+	fprintf(out, ", \"cpu_model\": ");
+	json_string(out, meta->cpu_model);
+	fprintf(out, ", \"online_cpus\": %ld, \"fs_type\": ",
+	    sysconf(_SC_NPROCESSORS_ONLN));
+	json_string(out, meta->fs_type);
+	fprintf(out, ", \"mitigations\": ");
+	json_string(out, meta->mitigations);
+	fprintf(out, "},\n");
+}
+
+static void
+report_json(FILE *out, struct meter_ctx *ctx, struct report_row *rows,
+    struct report_meta *meta)
+{
+	struct meter_settings *s = ctx->settings;
+
+	json_header(out, ctx, meta);
+	fprintf(out, "  \"window_ns\": %lu,\n  \"workers\": [\n",
+	    meta->window_ns);
+	for (long i = 0; i < s->ncpu; i++) {
+		fprintf(out, "    ");
+		json_row(out, &rows[i], s->baseline_ns);
+		fprintf(out, i + 1 < s->ncpu ? ",\n" : "\n");
+	}
+	fprintf(out, "  ],\n  \"total\": ");
+	json_row(out, &rows[s->ncpu], s->baseline_ns);
+	fprintf(out, "\n}\n");
+}
+
+/* CSV fields are never quoted by us, so strip what would break a row */
+static void
+csv_string(FILE *out, const char *str)
+{
+	for (const char *p = str != NULL ? str : ""; *p != '\0'; p++)
+		fputc((*p == ',' || *p == '\n' || *p == '"') ? ';' : *p, out);
+}
+
+#define CSV_META_HEADER                                              \
+	"mode,options,workers,execution,cycles,duration_s,warmup_s,"  \
+	"file_count,file_size,rate,baseline_ns,data,kernel,cpu_model," \
+	"fs_type,mitigations"
+
+/* Run metadata leading every row, ends with a separator */
+static void
+csv_meta(FILE *out, struct meter_ctx *ctx, struct report_meta *meta)
+{
+	struct meter_settings *s = ctx->settings;
+	char data[32];
+
+	csv_string(out, s->mode);
+	fputc(',', out);
+	csv_string(out, s->options);
+	fprintf(out, ",%ld,%s,%ld,%ld,%ld,%d,%lu,%.3f,%.1f,", s->ncpu,
+	    s->threads ? "threads" : "processes", s->cycles, s->duration,
+	    s->warmup, s->file_count, s->file_size, s->rate, s->baseline_ns);
+	datagen_name(&s->data, data, sizeof(data));
+	csv_string(out, data);
+	fputc(',', out);
+	csv_string(out, meta->kernel);
+	fputc(',', out);
+	csv_string(out, meta->cpu_model);
+	fputc(',', out);
+	csv_string(out, meta->fs_type);
+	fputc(',', out);
+	csv_string(out, meta->mitigations);
+	fputc(',', out);
+}
+
+/*
+ * One row per worker plus the "all" row, each carrying the run metadata
+ * so that rows can be ingested independently. Net latency columns are
+ * left empty unless --baseline was given.
+ */
+static void
+report_csv(FILE *out, struct meter_ctx *ctx, struct report_row *rows,
+    struct report_meta *meta)
+{
+	struct meter_settings *s = ctx->settings;
+
+	fprintf(out,
+	    CSV_META_HEADER ",window_ns,"
+	    "worker,cpu,ops,bytes,items,errors,elapsed_ns,ops_per_sec,"
+	    "mb_per_sec,items_per_sec,"
+	    "lock_wait_ns,syscall_ns,samples,avg_ns,p50_ns,p90_ns,p99_ns,"
+	    "p999_ns,max_ns,net_avg_ns,net_p50_ns,net_p90_ns,net_p99_ns,"
+	    "net_p999_ns,net_max_ns\n");
+	for (long i = 0; i <= s->ncpu; i++) {
+		struct report_row *row = &rows[i];
+		struct report_row net;
+
+		csv_meta(out, ctx, meta);
+		fprintf(out, "%lu,", meta->window_ns);
+		if (row->id >= 0)
+			fprintf(out, "%ld,%d", row->id, row->cpu);
+		else
+			fprintf(out, "all,");
+		fprintf(out,
+		    ",%ld,%ld,%ld,%ld,%lu,%.3f,%.3f,%.3f,%.0f,%.0f,%lu,%.1f,"
+		    "%.0f,%.0f,%.0f,%.0f,%.0f,",
+		    row->ops, row->bytes, row->items, row->errors,
+		    row->elapsed_ns, row->ops_rate, row->mb_rate,
+		    row->items_rate, row->lock_wait_ns,
+		    row->syscall_ns, row->samples, row->avg, row->p50, row->p90,
+		    row->p99, row->p999, row->max);
+		if (s->baseline_ns > 0) {
+			net = *row;
+			net_latency(&net, s->baseline_ns);
+			fprintf(out, "%.1f,%.0f,%.0f,%.0f,%.0f,%.0f\n", net.avg,
+			    net.p50, net.p90, net.p99, net.p999, net.max);
+		} else {
+			fprintf(out, ",,,,,\n");
+		}
+	}
+}
+
+static void
+fill_meta(struct meter_ctx *ctx, struct report_meta *meta)
+{
+	memset(meta, 0, sizeof(struct report_meta));
+	if (ctx->settings->duration > 0 && ctx->control->measure_ns > 0 &&
+	    ctx->control->stop_ns > ctx->control->measure_ns)
+		meta->window_ns = ctx->control->stop_ns -
+		    ctx->control->measure_ns;
+
+	if (ctx->settings->format == FORMAT_TEXT)
+		return;
+
+	sysinfo_kernel(meta->kernel, sizeof(meta->kernel));
+	sysinfo_cpu_model(meta->cpu_model, sizeof(meta->cpu_model));
+	sysinfo_fs_type(ctx->settings->temp_dir, meta->fs_type,
+	    sizeof(meta->fs_type));
+	sysinfo_mitigations(meta->mitigations, sizeof(meta->mitigations));
+}
+
+/*
+ * Called by the parent once every worker has exited. Results are read
+ * from the shared stats region and written in the --format flavour.
+ */
+void
+report_results(struct meter_ctx *ctx, FILE *out)
+{
+	struct report_meta meta;
+	struct report_row *rows;
+
+	fill_meta(ctx, &meta);
+	rows = build_rows(ctx, meta.window_ns);
+	if (rows == NULL) {
+		printf("Can't allocate results\n");
+		return;
+	}
+
+	switch (ctx->settings->format) {
+	case FORMAT_JSON:
+		report_json(out, ctx, rows, &meta);
+		break;
+	case FORMAT_CSV:
+		report_csv(out, ctx, rows, &meta);
+		break;
+	default:
+		report_text(out, ctx, rows, &meta);
+		break;
+	}
+
+	fflush(out);
+	free(rows);
+}
+
+/* Keep overall results of a --sweep step before the next one runs */
+void
+report_collect_step(struct meter_ctx *ctx, struct report_step *step)
+{
+	struct report_meta meta;
+	struct report_row *rows, *all;
+
+	memset(step, 0, sizeof(struct report_step));
+	step->workers = ctx->settings->ncpu;
+
+	fill_meta(ctx, &meta);
+	rows = build_rows(ctx, meta.window_ns);
+	if (rows == NULL) {
+		printf("Can't allocate results\n");
+		return;
+	}
+
+	all = &rows[ctx->settings->ncpu];
+	step->ops = all->ops;
+	step->errors = all->errors;
+	step->ops_rate = all->ops_rate;
+	step->mb_rate = all->mb_rate;
+	step->items_rate = all->items_rate;
+	step->avg = all->avg;
+	step->p50 = all->p50;
+	step->p99 = all->p99;
+	step->p999 = all->p999;
+
+	net_latency(all, ctx->settings->baseline_ns);
+	step->net_avg = all->avg;
+	step->net_p50 = all->p50;
+	step->net_p99 = all->p99;
+	step->net_p999 = all->p999;
+
+	free(rows);
+}
+
+/*
+ * Scaling efficiency compares per-worker throughput of a step with the
+ * first step, normally the 1 worker baseline.
+ */
+static double
+step_efficiency(struct report_step *steps, int i)
+{
+	double base;
+
+	if (steps[0].workers == 0 || steps[0].ops_rate <= 0)
+		return (0.0);
+	base = steps[0].ops_rate / steps[0].workers;
+	return (steps[i].ops_rate / (base * steps[i].workers));
+}
+
+/* Net latency of a step in JSON, only when --baseline was given */
+static void
+json_step_net(FILE *out, struct meter_ctx *ctx, struct report_step *step)
+{
+	if (ctx->settings->baseline_ns <= 0)
+		return;
+
+	fprintf(out,
+	    ", \"net_latency_ns\": {\"avg\": %.1f, \"p50\": %.0f, "
+	    "\"p99\": %.0f, \"p99.9\": %.0f}",
+	    step->net_avg, step->net_p50, step->net_p99, step->net_p999);
+}
+
+void
+report_sweep(struct meter_ctx *ctx, FILE *out, struct report_step *steps,
+    int n)
+{
+	double baseline = ctx->settings->baseline_ns;
+	struct report_meta meta;
+
+	fill_meta(ctx, &meta);
+
+	switch (ctx->settings->format) {
+	case FORMAT_JSON:
+		json_header(out, ctx, &meta);
+		fprintf(out, "  \"sweep\": [\n");
+		for (int i = 0; i < n; i++) {
+			fprintf(out,
+			    "    {\"workers\": %ld, \"ops\": %ld, "
+			    "\"errors\": %ld, \"ops_per_sec\": %.3f, "
+			    "\"mb_per_sec\": %.3f, \"items_per_sec\": %.3f, "
+			    "\"efficiency\": %.4f, "
+			    "\"latency_ns\": {\"avg\": %.1f, \"p50\": %.0f, "
+			    "\"p99\": %.0f, \"p99.9\": %.0f}",
+			    steps[i].workers, steps[i].ops, steps[i].errors,
+			    steps[i].ops_rate, steps[i].mb_rate,
+			    steps[i].items_rate,
+			    step_efficiency(steps, i), steps[i].avg,
+			    steps[i].p50, steps[i].p99, steps[i].p999);
+			json_step_net(out, ctx, &steps[i]);
+			fprintf(out, "}%s\n", i + 1 < n ? "," : "");
+		}
+		fprintf(out, "  ]\n}\n");
+		break;
+	case FORMAT_CSV:
+		fprintf(out,
+		    CSV_META_HEADER ",step_workers,ops,errors,ops_per_sec,"
+				    "mb_per_sec,items_per_sec,efficiency,"
+				    "avg_ns,p50_ns,p99_ns,p999_ns,net_avg_ns,"
+				    "net_p50_ns,net_p99_ns,net_p999_ns\n");
+		for (int i = 0; i < n; i++) {
+			csv_meta(out, ctx, &meta);
+			fprintf(out, "%ld,%ld,%ld,%.3f,%.3f,%.3f,%.4f,%.1f,%.0f,%.0f,%.0f,",
+			    steps[i].workers, steps[i].ops, steps[i].errors,
+			    steps[i].ops_rate, steps[i].mb_rate,
+			    steps[i].items_rate,
+			    step_efficiency(steps, i), steps[i].avg,
+			    steps[i].p50, steps[i].p99, steps[i].p999);
+			if (baseline > 0)
+				fprintf(out, "%.1f,%.0f,%.0f,%.0f\n",
+				    steps[i].net_avg, steps[i].net_p50,
+				    steps[i].net_p99, steps[i].net_p999);
+			else
+				fprintf(out, ",,,\n");
+		}
+		break;
+	default:
+		fprintf(out, "Sweep (%s):\n", ctx->settings->mode);
+		fprintf(out, "%8s %12s %10s %10s %10s %10s %10s %10s\n",
+		    "workers", "ops/s", "MB/s", "errors", "avg ns", "p50 ns",
+		    "p99 ns", "scaling");
+		for (int i = 0; i < n; i++) {
+			fprintf(out,
+			    "%8ld %12.0f %10.1f %10ld %10.0f %10.0f %10.0f %9.1f%%\n",
+			    steps[i].workers, steps[i].ops_rate,
+			    steps[i].mb_rate, steps[i].errors, steps[i].avg,
+			    steps[i].p50, steps[i].p99,
+			    100.0 * step_efficiency(steps, i));
+		}
+		if (baseline <= 0)
+			break;
+		fprintf(out,
+		    "Sweep latency net of %.1f ns syscall baseline, once per op:\n",
+		    baseline);
+		fprintf(out, "%8s %10s %10s %10s %10s\n", "workers", "avg ns",
+		    "p50 ns", "p99 ns", "p99.9 ns");
+		for (int i = 0; i < n; i++)
+			fprintf(out, "%8ld %10.0f %10.0f %10.0f %10.0f\n",
+			    steps[i].workers, steps[i].net_avg,
+			    steps[i].net_p50, steps[i].net_p99,
+			    steps[i].net_p999);
+		break;
+	}
+
+	fflush(out);
+}
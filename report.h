@@ -0,0 +1,24 @@
+#ifndef _REPORT_H_
+#define _REPORT_H_
+
+#include <stdio.h>
+
+#include "syscallmeter.h"
+
+/* Overall results of one --sweep step */
+typedef struct report_step {
+	long workers;
+	long ops;
+	long errors;
+	double ops_rate;
+	double mb_rate;
+	double items_rate;
+	double avg, p50, p99, p999; /* Latency in ns */
+	double net_avg, net_p50, net_p99, net_p999; /* Net of --baseline */
+} report_step_t;
+
+void report_results(struct meter_ctx *, FILE *);
+void report_collect_step(struct meter_ctx *, struct report_step *);
+void report_sweep(struct meter_ctx *, FILE *, struct report_step *, int);
+
+#endif /* !_REPORT_H_ */
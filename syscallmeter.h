@@ -3,9 +3,18 @@
 
 #include <sys/param.h>
 #include <semaphore.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "datagen.h"
+#include "histogram.h"
+#include "ticks.h"
 
 #define FNAME	"file_%d"
 #define MAX_WORKERS 256
+#define CACHELINE_SIZE 128 /* Covers adjacent-line prefetch on x86 */
+
+enum meter_format { FORMAT_TEXT, FORMAT_JSON, FORMAT_CSV };
 
 /**
  * Settings
@@ -20,15 +29,62 @@ typedef struct meter_settings {
 	char *options;
 	long ncpu;
 	char progress;
+	char threads;		     /* Run workers as threads (-T) */
+	double ns_per_tick;
+	char *placement;	     /* -a policy or CPU list, NULL to float */
+	int cpu_map[MAX_WORKERS]; /* Worker to CPU mapping for placement */
+	int parent_cpu;		     /* Spare CPU for the parent or -1 */
+	long duration;		     /* -t seconds, 0 for iteration bound */
+	long warmup;		     /* -w seconds excluded from results */
+	enum meter_format format;    /* --format of the final report */
+	int sweep[MAX_WORKERS];	     /* --sweep worker counts */
+	int sweep_len;		     /* 0 for a single run */
+	double rate;		     /* --rate total ops/s, 0 for closed loop */
+	struct meter_data data;	     /* --data pattern of written payload */
+	int baseline;		     /* --baseline, measure null syscall cost */
+	double baseline_ns;	     /* Cost of a null syscall, 0 if not measured */
 } meter_setting_t;
 
+/*
+ * Run phases. Only operations completed in METER_MEASURE are accounted.
+ * Iteration bound runs stay in METER_MEASURE for the whole job.
+ */
+enum meter_phase { METER_WARMUP, METER_MEASURE, METER_STOP };
+
+/* Shared run control, read by workers on every operation */
+typedef struct meter_control {
+	volatile int phase;
+	uint64_t measure_ns; /* CLOCK_MONOTONIC when measurement began */
+	uint64_t stop_ns;    /* CLOCK_MONOTONIC when measurement ended */
+} __attribute__((aligned(CACHELINE_SIZE))) meter_control_t;
+
+/*
+ * Per-worker results, one block per worker in the shared stats region.
+ * Each block starts on its own cache line so that workers bumping their
+ * counters do not false-share with neighbours.
+ */
 typedef struct meter_stats {
-    long cycles;
-} metet_stats_t;
+	long ops;		/* Completed operations */
+	long bytes;		/* Payload bytes read or written */
+	long items;		/* Workload units, e.g. directory entries */
+	long errors;		/* Failed syscalls */
+	uint64_t lock_wait;	/* Ticks spent waiting for locks */
+	uint64_t syscall_time;	/* Ticks spent in operations minus lock wait */
+	uint64_t elapsed_ns;	/* Wall time of the job */
+	struct meter_histo latency /* Per-operation latency in ticks */
+	    __attribute__((aligned(CACHELINE_SIZE)));
+} __attribute__((aligned(CACHELINE_SIZE))) meter_stats_t;
 
 typedef struct meter_worker_state {
     struct meter_settings *settings;
     struct meter_stats *my_stats;
+    struct meter_control *control;
+    int id;		   /* Worker index, 0 .. ncpu - 1 */
+    uint64_t op_lock_wait; /* Lock wait inside the current operation */
+    uint64_t op_lag;	   /* Issue delay behind the schedule (--rate) */
+    uint64_t pace_next;	   /* Intended start of the next operation */
+    uint64_t pace_interval; /* Ticks between operations, 0 for closed loop */
+    int measuring;	   /* Warmup counters are already dropped */
     void *opaque;
 } meter_worker_state_t;
 
@@ -41,6 +97,8 @@ typedef struct meter_ctx {
 	struct meter_settings *settings; /* Global params  */
 	struct meter_semaphores *sems;	 /* Semaphores to launch workers */
 	struct meter_stats *stats;	 /* Actual results */
+	struct meter_control *control;	 /* Run phase shared with workers */
+	FILE *out;			 /* Final report destination */
 } meter_ctx_t;
 
 typedef int (*worker_init_t)(struct meter_settings *, int);
@@ -51,14 +109,142 @@ typedef int (*worker_init_t)(struct meter_settings *, int);
  */
 typedef long (*worker_job_t)(int, struct meter_worker_state *, int);
 typedef int (*worker_opt_t)(char*);
+/* Optional: bring state back before another run on the same dataset */
+typedef int (*worker_reset_t)(struct meter_settings *, int);
+/* Optional: stop helper processes of the workload once all workers are gone */
+typedef void (*worker_finish_t)(struct meter_settings *);
+/* Optional: print workload specific results once all workers are done */
+typedef void (*worker_report_t)(struct meter_settings *);
 
 typedef struct {
 	worker_init_t init;
 	worker_opt_t opt;
 	worker_job_t job;
+	worker_reset_t reset;
+	worker_finish_t finish;
+	worker_report_t report;
 } worker_func;
 
+/*
+ * Loop condition of jobs: cycles for iteration bound runs, the stop flag
+ * for duration bound ones (-t).
+ */
+static inline int
+meter_continue(struct meter_worker_state *s, long i)
+{
+	if (s->settings->duration > 0)
+		return (s->control->phase != METER_STOP);
+	return (i < s->settings->cycles);
+}
+
+static inline int
+meter_stopped(struct meter_worker_state *s)
+{
+	return (s->control->phase == METER_STOP);
+}
+
+/*
+ * Returns non-zero within the measurement window. Counters collected
+ * during warmup are dropped once the worker observes the window start.
+ */
+static inline int
+meter_measuring(struct meter_worker_state *s)
+{
+	if (s->control->phase != METER_MEASURE)
+		return (0);
+
+	if (!s->measuring) {
+		s->measuring = 1;
+		s->my_stats->ops = 0;
+		s->my_stats->bytes = 0;
+		s->my_stats->items = 0;
+		s->my_stats->errors = 0;
+		s->my_stats->lock_wait = 0;
+		s->my_stats->syscall_time = 0;
+	}
+	return (1);
+}
+
+void meter_pace_wait(struct meter_worker_state *, uint64_t);
+
+/*
+ * Open-loop pacing (--rate): reserve n slots of the worker schedule and
+ * wait for the last one. Returns the intended start of the first slot,
+ * the next ones follow pace_interval apart. A worker behind schedule
+ * issues back to back and keeps the intended start times, so a stall
+ * shows up in the latency of every operation queued behind it.
+ */
+static inline uint64_t
+meter_pace(struct meter_worker_state *s, unsigned n)
+{
+	uint64_t first, now;
+
+	now = vi_tmGetTicks();
+	s->op_lag = 0;
+	if (s->pace_interval == 0)
+		return (now);
+
+	first = s->pace_next;
+	s->pace_next += s->pace_interval * n;
+	if (now < s->pace_next - s->pace_interval) {
+		meter_pace_wait(s, s->pace_next - s->pace_interval);
+		now = vi_tmGetTicks();
+	}
+	s->op_lag = now - first;
+	return (first);
+}
+
+/*
+ * Operation timing: a job takes the start mark right before the measured
+ * syscall(s) and hands it back once the operation is over. With --rate
+ * the mark is the intended start rather than the actual one.
+ */
+static inline uint64_t
+meter_op_begin(struct meter_worker_state *s)
+{
+	uint64_t start;
+
+	start = meter_pace(s, 1);
+	meter_measuring(s);
+	s->op_lock_wait = 0;
+	return (start);
+}
+
+/* Account an operation timed by the job itself (e.g. async engines) */
+static inline void
+meter_op_record(struct meter_worker_state *s, uint64_t ticks)
+{
+	uint64_t overhead;
+
+	if (!meter_measuring(s))
+		return;
+
+	overhead = s->op_lock_wait + s->op_lag;
+	histo_record(&s->my_stats->latency, ticks);
+	if (ticks > overhead)
+		s->my_stats->syscall_time += ticks - overhead;
+	s->my_stats->ops++;
+}
+
+static inline void
+meter_op_end(struct meter_worker_state *s, uint64_t start)
+{
+	meter_op_record(s, vi_tmGetTicks() - start);
+}
+
+/* Lock wait is a part of the operation, but not of its syscalls */
+static inline void
+meter_lock_wait(struct meter_worker_state *s, uint64_t ticks)
+{
+	s->my_stats->lock_wait += ticks;
+	s->op_lock_wait += ticks;
+}
+
+uint64_t meter_now_ns(void);
+void meter_stop(struct meter_control *);
 int make_files(struct meter_settings *, int);
-char *alloc_rndbytes(size_t);
+int make_files_forget(int);
+int reserve_fds(struct meter_settings *, long);
+char *alloc_rndbytes(struct meter_settings *, size_t);
 
 #endif /* !_SYSCALLMETER_H_ */
@@ -0,0 +1,144 @@
+#define _GNU_SOURCE
+
+#include <sys/statfs.h>
+#include <sys/utsname.h>
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sysinfo.h"
+
+/* "release version machine" of the running kernel */
+int
+sysinfo_kernel(char *buf, size_t len)
+{
+	struct utsname u;
+
+	if (uname(&u) != 0) {
+		snprintf(buf, len, "unknown");
+		return (-1);
+	}
+
+	snprintf(buf, len, "%s %s %s", u.release, u.version, u.machine);
+	return (0);
+}
+
+int
+sysinfo_cpu_model(char *buf, size_t len)
+{
+	char line[512];
+	char *p;
+	FILE *f;
+
+	snprintf(buf, len, "unknown");
+	f = fopen("/proc/cpuinfo", "r");
+	if (f == NULL)
+		return (-1);
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		/* x86 reports "model name", arm64 only "CPU part" and friends */
+		if (strncmp(line, "model name", 10) != 0 &&
+		    strncmp(line, "Model", 5) != 0)
+			continue;
+		p = strchr(line, ':');
+		if (p == NULL)
+			continue;
+		for (p++; *p == ' ' || *p == '\t'; p++)
+			;
+		p[strcspn(p, "\n")] = '\0';
+		snprintf(buf, len, "%s", p);
+		fclose(f);
+		return (0);
+	}
+
+	fclose(f);
+	return (-1);
+}
+
+/*
+ * Filesystem type of the path: the longest mount point from
+ * /proc/self/mounts covering it, or the statfs() magic as a fallback.
+ */
+int
+sysinfo_fs_type(const char *path, char *buf, size_t len)
+{
+	char real[PATH_MAX];
+	char line[4096], mnt[PATH_MAX], type[64];
+	struct statfs st;
+	size_t best, mlen;
+	FILE *f;
+
+	snprintf(buf, len, "unknown");
+	if (realpath(path, real) == NULL)
+		return (-1);
+
+	best = 0;
+	f = fopen("/proc/self/mounts", "r");
+	if (f != NULL) {
+		while (fgets(line, sizeof(line), f) != NULL) {
+			if (sscanf(line, "%*s %4095s %63s", mnt, type) != 2)
+				continue;
+			mlen = strlen(mnt);
+			if (strncmp(real, mnt, mlen) != 0 ||
+			    (real[mlen] != '/' && real[mlen] != '\0' &&
+				strcmp(mnt, "/") != 0))
+				continue;
+			if (mlen >= best) {
+				best = mlen;
+				snprintf(buf, len, "%s", type);
+			}
+		}
+		fclose(f);
+	}
+
+	if (best == 0 && statfs(real, &st) == 0)
+		snprintf(buf, len, "0x%lx", (unsigned long)st.f_type);
+
+	return (0);
+}
+
+#define VULN_DIR "/sys/devices/system/cpu/vulnerabilities"
+
+/*
+ * "name: state | ..." of every CPU vulnerability the kernel mitigates or
+ * leaves open, the ones the CPU is not affected by are skipped.
+ */
+int
+sysinfo_mitigations(char *buf, size_t len)
+{
+	struct dirent **names;
+	char path[PATH_MAX], state[256];
+	size_t off = 0;
+	FILE *f;
+	int n;
+
+	snprintf(buf, len, "unknown");
+	n = scandir(VULN_DIR, &names, NULL, alphasort);
+	if (n < 0)
+		return (-1);
+
+	snprintf(buf, len, "none");
+	for (int i = 0; i < n; i++) {
+		if (names[i]->d_name[0] == '.')
+			goto next;
+		snprintf(path, sizeof(path), VULN_DIR "/%s", names[i]->d_name);
+		f = fopen(path, "r");
+		if (f == NULL)
+			goto next;
+		if (fgets(state, sizeof(state), f) != NULL) {
+			state[strcspn(state, "\n")] = '\0';
+			if (strcmp(state, "Not affected") != 0 && off < len)
+				off += snprintf(buf + off, len - off, "%s%s: %s",
+				    off > 0 ? " | " : "", names[i]->d_name,
+				    state);
+		}
+		fclose(f);
+next:
+		free(names[i]);
+	}
+	free(names);
+	return (0);
+}
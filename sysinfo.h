@@ -0,0 +1,11 @@
+#ifndef _SYSINFO_H_
+#define _SYSINFO_H_
+
+#include <stddef.h>
+
+int sysinfo_kernel(char *, size_t);
+int sysinfo_cpu_model(char *, size_t);
+int sysinfo_fs_type(const char *, char *, size_t);
+int sysinfo_mitigations(char *, size_t);
+
+#endif /* !_SYSINFO_H_ */
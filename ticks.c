@@ -0,0 +1,33 @@
+#include <stdint.h>
+#include <time.h>
+
+#include "ticks.h"
+
+#define CALIBRATE_NS (50 * 1000 * 1000)
+
+/*
+ * Returns nanoseconds per tick of vi_tmGetTicks(), measured against
+ * CLOCK_MONOTONIC. Latencies are recorded in raw ticks by workers and
+ * converted by the parent with this factor.
+ */
+double
+ticks_calibrate(void)
+{
+	struct timespec ts_start, ts_end;
+	uint64_t start, end;
+	long delta;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts_start);
+	start = vi_tmGetTicks();
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &ts_end);
+		delta = (ts_end.tv_sec - ts_start.tv_sec) * 1000000000L +
+		    (ts_end.tv_nsec - ts_start.tv_nsec);
+	} while (delta < CALIBRATE_NS);
+	end = vi_tmGetTicks();
+
+	if (end <= start)
+		return (1.0);
+
+	return ((double)delta / (double)(end - start));
+}
@@ -1,3 +1,6 @@
+#ifndef _TICKS_H_
+#define _TICKS_H_
+
 #include <emmintrin.h>
 #include <stdint.h>
 
@@ -45,3 +48,7 @@
 #	else
 #		error "You need to define function(s) for your OS and CPU"
 #	endif
+
+double ticks_calibrate(void);
+
+#endif /* !_TICKS_H_ */
@@ -0,0 +1,214 @@
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+static int
+sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return ((int)syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+    unsigned flags)
+{
+	return ((int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+	    flags, NULL, 0));
+}
+
+/*
+ * Returns 0 on success, -errno on failure (io_uring may be disabled or
+ * the requested flags unsupported by the kernel).
+ */
+int
+uring_init(struct meter_uring *r, unsigned entries, unsigned flags)
+{
+	struct io_uring_params p;
+	int err;
+
+	memset(r, 0, sizeof(struct meter_uring));
+	memset(&p, 0, sizeof(p));
+	p.flags = flags;
+	if (flags & IORING_SETUP_SQPOLL)
+		p.sq_thread_idle = 1000;
+
+	r->fd = sys_io_uring_setup(entries, &p);
+	if (r->fd < 0)
+		return (-errno);
+	r->flags = flags;
+
+	r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_ring_size = p.cq_off.cqes +
+	    p.cq_entries * sizeof(struct io_uring_cqe);
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ring == MAP_FAILED)
+		goto fail;
+
+	r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	if (r->cq_ring == MAP_FAILED)
+		goto unmap_sq;
+
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto unmap_cq;
+
+	r->sq_head = (unsigned *)((char *)r->sq_ring + p.sq_off.head);
+	r->sq_tail = (unsigned *)((char *)r->sq_ring + p.sq_off.tail);
+	r->sq_mask = (unsigned *)((char *)r->sq_ring + p.sq_off.ring_mask);
+	r->sq_flags = (unsigned *)((char *)r->sq_ring + p.sq_off.flags);
+	r->sq_array = (unsigned *)((char *)r->sq_ring + p.sq_off.array);
+	r->sq_entries = p.sq_entries;
+	r->sqe_tail = *r->sq_tail;
+
+	r->cq_head = (unsigned *)((char *)r->cq_ring + p.cq_off.head);
+	r->cq_tail = (unsigned *)((char *)r->cq_ring + p.cq_off.tail);
+	r->cq_mask = (unsigned *)((char *)r->cq_ring + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)((char *)r->cq_ring + p.cq_off.cqes);
+
+	return (0);
+
+unmap_cq:
+	munmap(r->cq_ring, r->cq_ring_size);
+unmap_sq:
+	munmap(r->sq_ring, r->sq_ring_size);
+fail:
+	err = errno;
+	close(r->fd);
+	r->fd = -1;
+	return (-err);
+}
+
+void
+uring_exit(struct meter_uring *r)
+{
+	if (r->fd < 0)
+		return;
+
+	munmap(r->sqes, r->sqes_size);
+	munmap(r->cq_ring, r->cq_ring_size);
+	munmap(r->sq_ring, r->sq_ring_size);
+	close(r->fd);
+	r->fd = -1;
+}
+
+/* Returns zeroed SQE or NULL when the submission queue is full */
+struct io_uring_sqe *
+uring_get_sqe(struct meter_uring *r)
+{
+	struct io_uring_sqe *sqe;
+	unsigned head;
+
+	head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+	if (r->sqe_tail - head >= r->sq_entries)
+		return (NULL);
+
+	sqe = &r->sqes[r->sqe_tail & *r->sq_mask];
+	r->sq_array[r->sqe_tail & *r->sq_mask] = r->sqe_tail & *r->sq_mask;
+	r->sqe_tail++;
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	return (sqe);
+}
+
+/*
+ * Publish prepared SQEs and optionally wait for wait_nr completions.
+ * Returns number of submitted SQEs or -errno.
+ */
+int
+uring_submit(struct meter_uring *r, unsigned wait_nr)
+{
+	unsigned to_submit, flags;
+	int ret;
+
+	to_submit = r->sqe_tail - *r->sq_tail;
+	__atomic_store_n(r->sq_tail, r->sqe_tail, __ATOMIC_RELEASE);
+
+	flags = 0;
+	if (wait_nr > 0)
+		flags |= IORING_ENTER_GETEVENTS;
+
+	if (r->flags & IORING_SETUP_SQPOLL) {
+		/* The kernel thread picks SQEs up, wake it only if asleep */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(r->sq_flags, __ATOMIC_RELAXED) &
+		    IORING_SQ_NEED_WAKEUP)
+			flags |= IORING_ENTER_SQ_WAKEUP;
+		if (flags == 0)
+			return ((int)to_submit);
+		ret = sys_io_uring_enter(r->fd, 0, wait_nr, flags);
+		return (ret < 0 ? -errno : (int)to_submit);
+	}
+
+	do {
+		ret = sys_io_uring_enter(r->fd, to_submit, wait_nr, flags);
+	} while (ret < 0 && errno == EINTR);
+
+	return (ret < 0 ? -errno : ret);
+}
+
+/* Returns the next completion or NULL when none is available yet */
+struct io_uring_cqe *
+uring_peek_cqe(struct meter_uring *r)
+{
+	unsigned head;
+
+	head = *r->cq_head;
+	if (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+		return (&r->cqes[head & *r->cq_mask]);
+	return (NULL);
+}
+
+/* Blocks until a completion is available */
+struct io_uring_cqe *
+uring_wait_cqe(struct meter_uring *r)
+{
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	for (;;) {
+		cqe = uring_peek_cqe(r);
+		if (cqe != NULL)
+			return (cqe);
+
+		ret = sys_io_uring_enter(r->fd, 0, 1, IORING_ENTER_GETEVENTS);
+		if (ret < 0 && errno != EINTR)
+			return (NULL);
+	}
+}
+
+void
+uring_cqe_seen(struct meter_uring *r)
+{
+	__atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/* Register a table of nr empty slots for direct (fixed) descriptors */
+int
+uring_register_sparse_files(struct meter_uring *r, unsigned nr)
+{
+	int *fds;
+	int ret;
+
+	fds = malloc(nr * sizeof(int));
+	if (fds == NULL)
+		return (-ENOMEM);
+	for (unsigned i = 0; i < nr; i++)
+		fds[i] = -1;
+
+	ret = (int)syscall(__NR_io_uring_register, r->fd,
+	    IORING_REGISTER_FILES, fds, nr);
+	free(fds);
+
+	return (ret < 0 ? -errno : 0);
+}
@@ -0,0 +1,45 @@
+#ifndef _URING_H_
+#define _URING_H_
+
+#include <linux/io_uring.h>
+
+/*
+ * Minimal io_uring wrapper over raw syscalls, enough for the engines of
+ * the workloads: one submitter, completions reaped by the same thread.
+ */
+typedef struct meter_uring {
+	int fd;
+	unsigned flags;
+
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_flags;
+	unsigned *sq_array;
+	unsigned sq_entries;
+	unsigned sqe_tail; /* Prepared, but not yet published */
+
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	struct io_uring_sqe *sqes;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+} meter_uring_t;
+
+int uring_init(struct meter_uring *, unsigned, unsigned);
+void uring_exit(struct meter_uring *);
+struct io_uring_sqe *uring_get_sqe(struct meter_uring *);
+int uring_submit(struct meter_uring *, unsigned);
+struct io_uring_cqe *uring_peek_cqe(struct meter_uring *);
+struct io_uring_cqe *uring_wait_cqe(struct meter_uring *);
+void uring_cqe_seen(struct meter_uring *);
+int uring_register_sparse_files(struct meter_uring *, unsigned);
+
+#endif /* !_URING_H_ */
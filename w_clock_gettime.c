@@ -5,6 +5,7 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
@@ -60,6 +61,8 @@ w_clock_gettime_job(int workerid, struct meter_worker_state *s, int dirfd)
 	uint64_t ps;
 	uint64_t ticks, prev, delta;
 	uint64_t sum, avg, avg2, t1, t2, max, t1_count, t2_count;
+	uint64_t start;
+	long n, nstats;
 	struct rusage rusage_before, rusage_after;
 
 	uint64_t *stats_base, *stats_ptr;
@@ -122,10 +125,12 @@ w_clock_gettime_job(int workerid, struct meter_worker_state *s, int dirfd)
 
 		getrusage(RUSAGE_SELF, &rusage_before);
 		sum = 0;
-		for (long i = 0; i < s->settings->cycles; i++) {
+		for (n = 0; meter_continue(s, n); n++) {
+			start = meter_op_begin(s);
 			prev = vi_tmGetTicks();
 
 			ticks = vi_tmGetTicks();
+			meter_op_end(s, start);
 			delta = ticks - prev;
 			if (max < delta) {
 				max = delta;
@@ -138,8 +143,8 @@ w_clock_gettime_job(int workerid, struct meter_worker_state *s, int dirfd)
 				sum += delta;
 			}
 
-			if (has_stats)
-				stats_base[i] = delta;
+			if (has_stats && n < s->settings->cycles)
+				stats_base[n] = delta;
 
 			// for (volatile int zzz = 0; zzz < 256; zzz++)
 			// 	asm("");
@@ -151,9 +156,8 @@ w_clock_gettime_job(int workerid, struct meter_worker_state *s, int dirfd)
 		    rusage_after.ru_nivcsw - rusage_before.ru_nivcsw,
 		    rusage_after.ru_nvcsw - rusage_before.ru_nvcsw);
 
-		if (s->settings->cycles > t1_count + t2_count) {
-			avg2 = sum /
-			    (s->settings->cycles - t1_count - t2_count);
+		if (n > t1_count + t2_count) {
+			avg2 = sum / (n - t1_count - t2_count);
 		} else {
 			avg2 = avg;
 		}
@@ -190,14 +194,16 @@ w_clock_gettime_job(int workerid, struct meter_worker_state *s, int dirfd)
 		sum = 0;
 		t1_count = 0;
 		t2_count = 0;
-		for (long i = 0; i < s->settings->cycles; i++) {
+		for (n = 0; meter_continue(s, n); n++) {
+			start = meter_op_begin(s);
 			clock_gettime(CLOCK_MONOTONIC, &tsprev);
 			clock_gettime(CLOCK_MONOTONIC, &ts);
+			meter_op_end(s, start);
 			delta = ((ts.tv_sec - tsprev.tv_sec) * 1000000000 +
 			    (ts.tv_nsec - tsprev.tv_nsec));
 
-			if (has_stats)
-				stats_base[i] = delta;
+			if (has_stats && n < s->settings->cycles)
+				stats_base[n] = delta;
 
 			if (max < delta) {
 				max = delta;
@@ -212,9 +218,8 @@ w_clock_gettime_job(int workerid, struct meter_worker_state *s, int dirfd)
 			}
 		}
 
-		if (s->settings->cycles > t1_count + t2_count) {
-			avg2 = sum /
-			    (s->settings->cycles - t1_count - t2_count);
+		if (n > t1_count + t2_count) {
+			avg2 = sum / (n - t1_count - t2_count);
 		} else {
 			avg2 = avg;
 		}
@@ -228,8 +233,10 @@ w_clock_gettime_job(int workerid, struct meter_worker_state *s, int dirfd)
 		break;
 	}
 
+	/* Duration bound runs keep the first cycles samples only */
+	nstats = MIN(n, s->settings->cycles);
 	if (workerid == s->settings->cpu_limit - 2) {
-		for (long i = 0; i < s->settings->cycles; i++) {
+		for (long i = 0; i < nstats; i++) {
 			int j;
 
 			if (has_histo)
@@ -297,5 +304,7 @@ w_clock_gettime_job(int workerid, struct meter_worker_state *s, int dirfd)
 		}
 	}
 
-	return (s->settings->cycles + MEASURECYCLES);
+	if (has_stats)
+		free(stats_base);
+	return (s->my_stats->ops);
 }
@@ -0,0 +1,263 @@
+#define _GNU_SOURCE
+#include <sys/param.h>
+#include <sys/mman.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "syscallmeter.h"
+#include "w_mmap.h"
+
+/*
+ * One operation maps a region of -s bytes (a dataset file or anonymous
+ * memory), faults it in every 'stride' bytes and unmaps it. With dontneed
+ * the region stays mapped and an operation is the faults plus
+ * madvise(MADV_DONTNEED), the way allocators return memory. Items are the
+ * pages touched. Run with -T to have all workers share one mm.
+ */
+typedef struct w_mmap_params {
+	int anon;	 /* Anonymous memory instead of dataset files */
+	size_t stride;	 /* Bytes between touched addresses */
+	int shared;	 /* MAP_SHARED, MAP_PRIVATE otherwise */
+	int populate;	 /* MAP_POPULATE, faults are taken by mmap() */
+	int dontneed;	 /* Keep the mapping, drop pages after touching */
+	int huge;	 /* madvise(MADV_HUGEPAGE) */
+	int hugetlb;	 /* MAP_HUGETLB, anonymous only */
+	int write;	 /* Write faults instead of read faults */
+} w_mmap_params_t;
+
+static struct w_mmap_params w_mmap_params = { .anon = 0,
+	.stride = 4096,
+	.shared = 1,
+	.populate = 0,
+	.dontneed = 0,
+	.huge = 0,
+	.hugetlb = 0,
+	.write = 0 };
+
+int
+w_mmap_option(char *option)
+{
+	char *end;
+
+	if (strcmp(option, "file") == 0) {
+		w_mmap_params.anon = 0;
+	} else if (strcmp(option, "anon") == 0) {
+		w_mmap_params.anon = 1;
+	} else if (strncmp(option, "stride=", 7) == 0) {
+		w_mmap_params.stride = strtoul(option + 7, &end, 10);
+		if (*end != '\0' || w_mmap_params.stride == 0) {
+			printf("invalid stride: %s\n", option);
+			return (-1);
+		}
+	} else if (strcmp(option, "shared") == 0) {
+		w_mmap_params.shared = 1;
+	} else if (strcmp(option, "private") == 0) {
+		w_mmap_params.shared = 0;
+	} else if (strcmp(option, "populate") == 0) {
+		w_mmap_params.populate = 1;
+	} else if (strcmp(option, "dontneed") == 0) {
+		w_mmap_params.dontneed = 1;
+	} else if (strcmp(option, "huge") == 0) {
+		w_mmap_params.huge = 1;
+	} else if (strcmp(option, "hugetlb") == 0) {
+		w_mmap_params.hugetlb = 1;
+	} else if (strcmp(option, "write") == 0) {
+		w_mmap_params.write = 1;
+	} else {
+		printf("unexpected option: %s\n", option);
+		return (-1);
+	}
+	return (0);
+}
+
+#define HUGEPAGE_DEF (2 * 1024 * 1024)
+
+/* Default huge page size of MAP_HUGETLB mappings */
+static size_t
+w_mmap_hugepage_size(void)
+{
+	char line[256];
+	size_t kb = 0;
+	FILE *f;
+
+	f = fopen("/proc/meminfo", "r");
+	if (f == NULL)
+		return (HUGEPAGE_DEF);
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "Hugepagesize: %zu kB", &kb) == 1)
+			break;
+	}
+	fclose(f);
+	return (kb > 0 ? kb * 1024 : HUGEPAGE_DEF);
+}
+
+int
+w_mmap_init(struct meter_settings *s, int dirfd)
+{
+	size_t hugepage;
+
+	if (w_mmap_params.hugetlb && !w_mmap_params.anon) {
+		printf("option hugetlb needs anon\n");
+		return (-1);
+	}
+	/* munmap() of a hugetlb mapping fails unless the length is aligned */
+	if (w_mmap_params.hugetlb) {
+		hugepage = w_mmap_hugepage_size();
+		if (s->file_size % hugepage != 0) {
+			printf("file size %lu is not a multiple of the %zu "
+			       "bytes huge page\n",
+			    s->file_size, hugepage);
+			return (-1);
+		}
+	}
+	if (w_mmap_params.anon)
+		return (0);
+
+	if (make_files(s, dirfd))
+		return (-1);
+	/* Writes through MAP_SHARED change the dataset for later runs */
+	if (w_mmap_params.shared && w_mmap_params.write &&
+	    make_files_forget(dirfd) != 0)
+		return (-1);
+	printf("Created files successfully\n");
+	return (0);
+}
+
+static void *
+w_mmap_map(struct meter_settings *s, int fd)
+{
+	int prot = PROT_READ | PROT_WRITE;
+	int flags = w_mmap_params.shared ? MAP_SHARED : MAP_PRIVATE;
+	void *addr;
+
+	if (fd < 0)
+		flags |= MAP_ANONYMOUS;
+	if (w_mmap_params.populate)
+		flags |= MAP_POPULATE;
+	if (w_mmap_params.hugetlb)
+		flags |= MAP_HUGETLB;
+
+	addr = mmap(NULL, s->file_size, prot, flags, fd, 0);
+	if (addr == MAP_FAILED)
+		return (NULL);
+	if (w_mmap_params.huge)
+		(void)madvise(addr, s->file_size, MADV_HUGEPAGE);
+	return (addr);
+}
+
+/* Fault the region in, returns the number of addresses touched */
+static long
+w_mmap_touch(struct meter_settings *s, char *addr)
+{
+	volatile char *p = addr;
+	long n = 0;
+
+	for (size_t off = 0; off < s->file_size; off += w_mmap_params.stride) {
+		if (w_mmap_params.write)
+			p[off] = (char)off;
+		else
+			(void)p[off];
+		n++;
+	}
+	return (n);
+}
+
+long
+w_mmap_job(int workerid, struct meter_worker_state *s, int dirfd)
+{
+	char filename[128];
+	int nregions, fd = -1;
+	char **regions;
+	uint64_t start;
+	long touched, ret = -1;
+
+	nregions = w_mmap_params.anon ? 1 : s->settings->file_count;
+	regions = calloc(nregions, sizeof(char *));
+	if (regions == NULL) {
+		printf("[%d] Can't allocate regions\n", workerid);
+		return (-1);
+	}
+
+	/* dontneed maps every region once, outside of the measurements */
+	for (int k = 0; w_mmap_params.dontneed && k < nregions; k++) {
+		fd = -1;
+		if (!w_mmap_params.anon) {
+			sprintf(filename, FNAME, k);
+			fd = openat(dirfd, filename, O_RDWR);
+			if (fd < 0) {
+				printf("[%d] Can't open file %s: %s\n",
+				    workerid, filename, strerror(errno));
+				goto done;
+			}
+		}
+		regions[k] = w_mmap_map(s->settings, fd);
+		if (fd >= 0)
+			close(fd);
+		fd = -1;
+		if (regions[k] == NULL) {
+			printf("[%d] Can't map region: %s\n", workerid,
+			    strerror(errno));
+			goto done;
+		}
+	}
+
+	for (long i = 0; meter_continue(s, i); i++) {
+		for (int k = 0; k < nregions && !meter_stopped(s); k++) {
+			fd = -1;
+			if (!w_mmap_params.anon && !w_mmap_params.dontneed) {
+				sprintf(filename, FNAME, k);
+				fd = openat(dirfd, filename, O_RDWR);
+				if (fd < 0) {
+					s->my_stats->errors++;
+					printf("[%d] Can't open file %s: %s\n",
+					    workerid, filename, strerror(errno));
+					goto done;
+				}
+			}
+
+			start = meter_op_begin(s);
+			if (!w_mmap_params.dontneed) {
+				regions[k] = w_mmap_map(s->settings, fd);
+				if (regions[k] == NULL) {
+					s->my_stats->errors++;
+					printf("[%d] Can't map region: %s\n",
+					    workerid, strerror(errno));
+					goto done;
+				}
+			}
+			touched = w_mmap_touch(s->settings, regions[k]);
+			if (w_mmap_params.dontneed) {
+				if (madvise(regions[k], s->settings->file_size,
+					MADV_DONTNEED) != 0)
+					s->my_stats->errors++;
+			} else {
+				if (munmap(regions[k],
+					s->settings->file_size) != 0)
+					s->my_stats->errors++;
+				regions[k] = NULL;
+			}
+			meter_op_end(s, start);
+
+			if (fd >= 0)
+				close(fd);
+			fd = -1;
+			if (meter_measuring(s))
+				s->my_stats->items += touched;
+		}
+	}
+
+	ret = s->my_stats->ops;
+done:
+	if (fd >= 0)
+		close(fd);
+	for (int k = 0; k < nregions; k++)
+		if (regions[k] != NULL)
+			munmap(regions[k], s->settings->file_size);
+	free(regions);
+	return (ret);
+}
@@ -0,0 +1,9 @@
+#ifndef _W_MMAP_H_
+#define _W_MMAP_H_
+
+int w_mmap_option(char *);
+
+int w_mmap_init(struct meter_settings *, int);
+long w_mmap_job(int, struct meter_worker_state *, int);
+
+#endif /* !_W_MMAP_H_ */
@@ -0,0 +1,157 @@
+#define _GNU_SOURCE
+#include <sys/syscall.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "syscallmeter.h"
+#include "sysinfo.h"
+#include "w_null.h"
+
+#define BATCH_MAX 1000000
+#define INVALID_NR 1023	    /* Above any syscall number, fails with ENOSYS */
+#define BASELINE_RUNS 101   /* Batches, the median one is taken */
+#define BASELINE_BATCH 1000 /* Calls per batch */
+
+/*
+ * Getpid, Getppid - syscall() of the cheapest real syscalls, the kernel
+ *                   entry and exit path with next to no work
+ * Invalid - an unknown syscall number, entry and exit only
+ * Vdso - clock_gettime() answered in user space by the vDSO
+ * VdsoSys - the same clock_gettime() forced into the kernel
+ */
+enum w_null_call { NULL_GETPID, NULL_GETPPID, NULL_INVALID, NULL_VDSO,
+	NULL_VDSOSYS };
+
+typedef struct w_null_params {
+	enum w_null_call call;
+	long batch; /* Calls per operation */
+} w_null_params_t;
+
+static struct w_null_params w_null_params = { .call = NULL_GETPID,
+	.batch = 1 };
+
+int
+w_null_option(char *option)
+{
+	char *end;
+
+	if (strcmp(option, "getpid") == 0) {
+		w_null_params.call = NULL_GETPID;
+	} else if (strcmp(option, "getppid") == 0) {
+		w_null_params.call = NULL_GETPPID;
+	} else if (strcmp(option, "invalid") == 0) {
+		w_null_params.call = NULL_INVALID;
+	} else if (strcmp(option, "vdso") == 0) {
+		w_null_params.call = NULL_VDSO;
+	} else if (strcmp(option, "vdsosys") == 0) {
+		w_null_params.call = NULL_VDSOSYS;
+	} else if (strncmp(option, "batch=", 6) == 0) {
+		w_null_params.batch = strtol(option + 6, &end, 10);
+		if (*end != '\0' || w_null_params.batch <= 0 ||
+		    w_null_params.batch > BATCH_MAX) {
+			printf("invalid batch: %s\n", option);
+			return (-1);
+		}
+	} else {
+		printf("unexpected option: %s\n", option);
+		return (-1);
+	}
+	return (0);
+}
+
+int
+w_null_init(struct meter_settings *s, int dirfd)
+{
+	(void)dirfd;
+
+	s->cycles *= 1000;
+	return (0);
+}
+
+static inline void
+w_null_call(enum w_null_call call)
+{
+	struct timespec ts;
+
+	switch (call) {
+	case NULL_GETPPID:
+		syscall(SYS_getppid);
+		break;
+	case NULL_INVALID:
+		syscall(INVALID_NR);
+		break;
+	case NULL_VDSO:
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		break;
+	case NULL_VDSOSYS:
+		syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+		break;
+	default:
+		syscall(SYS_getpid);
+		break;
+	}
+}
+
+/* One operation is a batch of calls, items count the calls */
+long
+w_null_job(int workerid, struct meter_worker_state *s, int dirfd)
+{
+	enum w_null_call call = w_null_params.call;
+	long batch = w_null_params.batch;
+	uint64_t start;
+
+	(void)workerid;
+	(void)dirfd;
+
+	for (long i = 0; meter_continue(s, i); i++) {
+		start = meter_op_begin(s);
+		for (long k = 0; k < batch; k++)
+			w_null_call(call);
+		meter_op_end(s, start);
+		s->my_stats->items += batch;
+	}
+	return (s->my_stats->ops);
+}
+
+void
+w_null_report(struct meter_settings *s)
+{
+	char mitigations[4096];
+
+	(void)s;
+
+	sysinfo_mitigations(mitigations, sizeof(mitigations));
+	printf("CPU mitigations: %s\n", mitigations);
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x < y ? -1 : x > y);
+}
+
+/*
+ * Cost of entering and leaving the kernel in ns: syscall(SYS_getpid) in
+ * the calling process, median of BASELINE_RUNS batches so that
+ * interrupts and migrations do not skew it.
+ */
+double
+w_null_baseline(struct meter_settings *s)
+{
+	uint64_t runs[BASELINE_RUNS], start;
+
+	for (int i = 0; i < BASELINE_RUNS; i++) {
+		start = vi_tmGetTicks();
+		for (int k = 0; k < BASELINE_BATCH; k++)
+			w_null_call(NULL_GETPID);
+		runs[i] = vi_tmGetTicks() - start;
+	}
+	qsort(runs, BASELINE_RUNS, sizeof(uint64_t), cmp_u64);
+	return (s->ns_per_tick * runs[BASELINE_RUNS / 2] / BASELINE_BATCH);
+}
@@ -0,0 +1,10 @@
+#ifndef _W_NULL_H_
+#define _W_NULL_H_
+
+int w_null_option(char *);
+int w_null_init(struct meter_settings *, int);
+long w_null_job(int, struct meter_worker_state *, int);
+void w_null_report(struct meter_settings *);
+double w_null_baseline(struct meter_settings *);
+
+#endif /* !_W_NULL_H_ */
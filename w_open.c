@@ -1,11 +1,63 @@
+#include <sys/param.h>
+
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "syscallmeter.h"
+#include "uring.h"
 #include "w_open.h"
 
 #define FNAME "file_%d"
+#define URING_QD_DEF 32
+
+/*
+ * Sync - openat() + close() per file
+ * Uring - batches of IORING_OP_OPENAT, then IORING_OP_CLOSE of the batch
+ */
+enum w_open_engine { SYNC, URING };
+
+typedef struct w_open_params {
+	enum w_open_engine engine;
+	unsigned qd;
+	int fixed;  /* Open into registered (direct) descriptors */
+	int sqpoll; /* Kernel thread polls the submission queue */
+} w_open_params_t;
+
+static struct w_open_params w_open_params = { .engine = SYNC,
+	.qd = URING_QD_DEF,
+	.fixed = 0,
+	.sqpoll = 0 };
+
+int
+w_open_option(char *option)
+{
+	char *end;
+
+	if (strcmp(option, "sync") == 0) {
+		w_open_params.engine = SYNC;
+	} else if (strcmp(option, "uring") == 0) {
+		w_open_params.engine = URING;
+	} else if (strncmp(option, "qd=", 3) == 0) {
+		w_open_params.qd = strtoul(option + 3, &end, 10);
+		if (*end != '\0' || w_open_params.qd == 0 ||
+		    w_open_params.qd > 4096) {
+			printf("invalid queue depth: %s\n", option);
+			return (-1);
+		}
+	} else if (strcmp(option, "fixed") == 0) {
+		w_open_params.fixed = 1;
+	} else if (strcmp(option, "sqpoll") == 0) {
+		w_open_params.sqpoll = 1;
+	} else {
+		printf("unexpected option: %s\n", option);
+		return (-1);
+	}
+	return (0);
+}
 
 int
 w_open_init(struct meter_settings *s, int dirfd)
@@ -16,24 +68,204 @@ w_open_init(struct meter_settings *s, int dirfd)
 	return (0);
 };
 
+/*
+ * Reap n completions of a batch submitted at 'start', adding the
+ * completion latency of every request to lat[] and its result to res[].
+ */
+static int
+w_open_uring_reap(struct meter_uring *ring, unsigned n, uint64_t start,
+    uint64_t *lat, int *res)
+{
+	struct io_uring_cqe *cqe;
+	unsigned slot;
+
+	for (unsigned i = 0; i < n; i++) {
+		cqe = uring_wait_cqe(ring);
+		if (cqe == NULL)
+			return (-1);
+		slot = (unsigned)cqe->user_data;
+		lat[slot] += vi_tmGetTicks() - start;
+		res[slot] = cqe->res;
+		uring_cqe_seen(ring);
+	}
+	return (0);
+}
+
+/* Submit the n queued SQEs, a short submit would leave the reap waiting */
+static int
+w_open_uring_submit(struct meter_uring *ring, unsigned n)
+{
+	int ret;
+
+	ret = uring_submit(ring, 0);
+	if (ret < 0) {
+		errno = -ret;
+		return (-1);
+	}
+	if ((unsigned)ret != n) {
+		errno = EAGAIN;
+		return (-1);
+	}
+	return (0);
+}
+
+static long
+w_open_uring_job(int workerid, struct meter_worker_state *s, int dirfd)
+{
+	struct meter_uring ring;
+	struct io_uring_sqe *sqe;
+	char(*names)[32];
+	uint64_t *lat;
+	uint64_t start, first, issued, intended;
+	int *res;
+	unsigned qd, n, nclose;
+	int err;
+
+	qd = w_open_params.qd;
+	err = uring_init(&ring, qd,
+	    w_open_params.sqpoll ? IORING_SETUP_SQPOLL : 0);
+	if (err != 0) {
+		printf("[%d] Can't set up io_uring: %s\n", workerid,
+		    strerror(-err));
+		return (-1);
+	}
+
+	if (w_open_params.fixed) {
+		err = uring_register_sparse_files(&ring, qd);
+		if (err != 0) {
+			printf("[%d] Can't register files: %s\n", workerid,
+			    strerror(-err));
+			uring_exit(&ring);
+			return (-1);
+		}
+	}
+
+	names = malloc(qd * sizeof(*names));
+	lat = malloc(qd * sizeof(uint64_t));
+	res = malloc(qd * sizeof(int));
+	if (names == NULL || lat == NULL || res == NULL) {
+		printf("[%d] Can't allocate batch\n", workerid);
+		free(names);
+		free(lat);
+		free(res);
+		uring_exit(&ring);
+		return (-1);
+	}
+
+	for (long i = 0; meter_continue(s, i); i++) {
+		for (int k = 0; k < s->settings->file_count && !meter_stopped(s);
+		     k += n) {
+			n = MIN(qd, (unsigned)(s->settings->file_count - k));
+
+			for (unsigned j = 0; j < n; j++) {
+				sprintf(names[j], FNAME, k + j);
+				sqe = uring_get_sqe(&ring);
+				if (sqe == NULL)
+					goto fail_sqe;
+				sqe->opcode = IORING_OP_OPENAT;
+				sqe->fd = dirfd;
+				sqe->addr = (uint64_t)(uintptr_t)names[j];
+				sqe->open_flags = O_RDWR;
+				sqe->user_data = j;
+				if (w_open_params.fixed)
+					sqe->file_index = j + 1;
+				lat[j] = 0;
+			}
+			/* The batch goes out once its last slot is due */
+			first = meter_pace(s, n);
+			start = issued = vi_tmGetTicks();
+			if (w_open_uring_submit(&ring, n) != 0)
+				goto fail_submit;
+			if (w_open_uring_reap(&ring, n, start, lat, res))
+				goto fail;
+
+			/* Failed opens keep their result and get no CLOSE */
+			nclose = 0;
+			for (unsigned j = 0; j < n; j++) {
+				if (res[j] < 0) {
+					printf("[%d] Can't open file %s: %s\n",
+					    workerid, names[j],
+					    strerror(-res[j]));
+					continue;
+				}
+				sqe = uring_get_sqe(&ring);
+				if (sqe == NULL)
+					goto fail_sqe;
+				sqe->opcode = IORING_OP_CLOSE;
+				sqe->user_data = j;
+				if (w_open_params.fixed)
+					sqe->file_index = j + 1;
+				else
+					sqe->fd = res[j];
+				nclose++;
+			}
+			start = vi_tmGetTicks();
+			if (w_open_uring_submit(&ring, nclose) != 0)
+				goto fail_submit;
+			if (w_open_uring_reap(&ring, nclose, start, lat, res))
+				goto fail;
+
+			/* A failed open or close is an error, not an operation */
+			for (unsigned j = 0; j < n; j++) {
+				if (res[j] < 0) {
+					s->my_stats->errors++;
+					continue;
+				}
+				intended = first + j * s->pace_interval;
+				s->op_lag = issued > intended ? issued - intended : 0;
+				meter_op_record(s, lat[j] + s->op_lag);
+			}
+		}
+	}
+
+	free(names);
+	free(lat);
+	free(res);
+	uring_exit(&ring);
+	return (s->my_stats->ops);
+
+fail_sqe:
+	/* The ring has qd entries and a batch never queues more */
+	printf("[%d] io_uring submission queue is full\n", workerid);
+	goto out;
+fail_submit:
+	printf("[%d] io_uring submit failed: %s\n", workerid, strerror(errno));
+	goto out;
+fail:
+	printf("[%d] io_uring wait failed: %s\n", workerid, strerror(errno));
+out:
+	free(names);
+	free(lat);
+	free(res);
+	uring_exit(&ring);
+	return (-1);
+}
+
 long
 w_open_job(int workerid, struct meter_worker_state *s, int dirfd)
 {
 	char filename[128];
+	uint64_t start;
 	int fd;
 
-	for (long i = 0; i < s->settings->cycles; i++) {
-		for (int k = 0; k < s->settings->file_count; k++) {
+	if (w_open_params.engine == URING)
+		return (w_open_uring_job(workerid, s, dirfd));
+
+	for (long i = 0; meter_continue(s, i); i++) {
+		for (int k = 0; k < s->settings->file_count && !meter_stopped(s);
+		     k++) {
 			sprintf(filename, FNAME, k);
+			start = meter_op_begin(s);
 			fd = openat(dirfd, filename, O_RDWR);
 			if (fd < 0) {
+				s->my_stats->errors++;
 				printf("[%d] Can't create or open file %s",
 				    workerid, filename);
 				return -1;
 			}
 			close(fd);
-			s->my_stats->cycles++;
+			meter_op_end(s, start);
 		}
 	}
-	return (s->my_stats->cycles);
+	return (s->my_stats->ops);
 }
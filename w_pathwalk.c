@@ -0,0 +1,248 @@
+#define _GNU_SOURCE
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <linux/openat2.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "syscallmeter.h"
+#include "w_pathwalk.h"
+
+#define DIRNAME "pathwalk"
+#define LEVELNAME "d%d"
+#define LINKNAME "link_%d"
+#define DEPTH_DEF 8
+#define DEPTH_MAX 256
+#define SYMLINKS_MAX 39 /* The kernel follows at most 40 in one walk */
+
+/*
+ * Files live at the bottom of a chain of depth directories:
+ * pathwalk/d0/d1/.../dN/file_K. With symlinks the walk starts at
+ * link_M -> link_M-1 -> ... -> link_0 -> d0 instead of d0.
+ * Rel - openat() of the path relative to -d
+ * Abs - open() of the absolute path, walks from / every time
+ * Openat2 - rel with RESOLVE_* flags (beneath, nosymlinks, cached)
+ */
+enum w_pathwalk_base { REL, ABS };
+
+typedef struct w_pathwalk_params {
+	enum w_pathwalk_base base;
+	int depth;
+	int symlinks;
+	uint64_t resolve; /* openat2() when not 0 */
+	int opath;	  /* O_PATH instead of O_RDONLY */
+} w_pathwalk_params_t;
+
+static struct w_pathwalk_params w_pathwalk_params = { .base = REL,
+	.depth = DEPTH_DEF,
+	.symlinks = 0,
+	.resolve = 0,
+	.opath = 0 };
+
+int
+w_pathwalk_option(char *option)
+{
+	char *end;
+	long val;
+
+	if (strcmp(option, "rel") == 0) {
+		w_pathwalk_params.base = REL;
+	} else if (strcmp(option, "abs") == 0) {
+		w_pathwalk_params.base = ABS;
+	} else if (strncmp(option, "depth=", 6) == 0) {
+		val = strtol(option + 6, &end, 10);
+		if (*end != '\0' || val < 0 || val > DEPTH_MAX) {
+			printf("invalid depth: %s\n", option);
+			return (-1);
+		}
+		w_pathwalk_params.depth = val;
+	} else if (strncmp(option, "symlinks=", 9) == 0) {
+		val = strtol(option + 9, &end, 10);
+		if (*end != '\0' || val < 0 || val > SYMLINKS_MAX) {
+			printf("invalid number of symlinks: %s\n", option);
+			return (-1);
+		}
+		w_pathwalk_params.symlinks = val;
+	} else if (strcmp(option, "beneath") == 0) {
+		w_pathwalk_params.resolve |= RESOLVE_BENEATH;
+	} else if (strcmp(option, "nosymlinks") == 0) {
+		w_pathwalk_params.resolve |= RESOLVE_NO_SYMLINKS;
+	} else if (strcmp(option, "cached") == 0) {
+		w_pathwalk_params.resolve |= RESOLVE_CACHED;
+	} else if (strcmp(option, "opath") == 0) {
+		w_pathwalk_params.opath = 1;
+	} else {
+		printf("unexpected option: %s\n", option);
+		return (-1);
+	}
+	return (0);
+}
+
+/* Open subdirectory name of dirfd, creating it when missing */
+static int
+w_pathwalk_mkdir(int dirfd, const char *name)
+{
+	int fd;
+
+	if (mkdirat(dirfd, name, 0775) != 0 && errno != EEXIST) {
+		printf("Can't create directory %s: %s\n", name,
+		    strerror(errno));
+		return (-1);
+	}
+	fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		printf("Can't open directory %s: %s\n", name, strerror(errno));
+	return (fd);
+}
+
+int
+w_pathwalk_init(struct meter_settings *s, int dirfd)
+{
+	struct meter_settings leaf_settings;
+	char name[32], target[32];
+	int fd, next;
+
+	if (w_pathwalk_params.base == ABS && w_pathwalk_params.resolve != 0) {
+		printf("openat2() resolution flags need relative paths\n");
+		return (-1);
+	}
+	if ((w_pathwalk_params.resolve & RESOLVE_NO_SYMLINKS) &&
+	    w_pathwalk_params.symlinks > 0) {
+		printf("nosymlinks would refuse every path with symlinks\n");
+		return (-1);
+	}
+	if (w_pathwalk_params.symlinks > 0 && w_pathwalk_params.depth == 0) {
+		printf("symlinks need a tree of depth 1 at least\n");
+		return (-1);
+	}
+
+	fd = w_pathwalk_mkdir(dirfd, DIRNAME);
+	if (fd < 0)
+		return (-1);
+
+	/* The chain points at d0 whatever the depth is */
+	for (int i = 0; i < w_pathwalk_params.symlinks; i++) {
+		sprintf(name, LINKNAME, i);
+		if (i == 0)
+			sprintf(target, LEVELNAME, 0);
+		else
+			sprintf(target, LINKNAME, i - 1);
+		if (symlinkat(target, fd, name) != 0 && errno != EEXIST) {
+			printf("Can't create symlink %s: %s\n", name,
+			    strerror(errno));
+			close(fd);
+			return (-1);
+		}
+	}
+
+	for (int i = 0; i < w_pathwalk_params.depth; i++) {
+		sprintf(name, LEVELNAME, i);
+		next = w_pathwalk_mkdir(fd, name);
+		close(fd);
+		if (next < 0)
+			return (-1);
+		fd = next;
+	}
+
+	/* Leaves are empty files, made and reused like the main dataset */
+	memcpy(&leaf_settings, s, sizeof(struct meter_settings));
+	leaf_settings.file_size = 0;
+	if (make_files(&leaf_settings, fd)) {
+		close(fd);
+		return (-1);
+	}
+	close(fd);
+	printf("Created tree of depth %d with %d files successfully\n",
+	    w_pathwalk_params.depth, s->file_count);
+	return (0);
+}
+
+/* Directory part of every path, relative to -d or absolute */
+static int
+w_pathwalk_prefix(struct meter_settings *s, char *buf, size_t len)
+{
+	char dir[PATH_MAX];
+	size_t off;
+
+	if (w_pathwalk_params.base == ABS) {
+		if (realpath(s->temp_dir, dir) == NULL)
+			return (-1);
+		off = snprintf(buf, len, "%s/" DIRNAME, dir);
+	} else {
+		off = snprintf(buf, len, DIRNAME);
+	}
+
+	for (int i = 0; i < w_pathwalk_params.depth && off < len; i++) {
+		if (i == 0 && w_pathwalk_params.symlinks > 0)
+			off += snprintf(buf + off, len - off, "/" LINKNAME,
+			    w_pathwalk_params.symlinks - 1);
+		else
+			off += snprintf(buf + off, len - off, "/" LEVELNAME, i);
+	}
+	return (off < len ? 0 : -1);
+}
+
+/*
+ * One operation is an open() and close() of a leaf. Items count the
+ * RESOLVE_CACHED walks that could not complete in RCU mode and were
+ * repeated without the flag, the way callers of RESOLVE_CACHED do.
+ */
+long
+w_pathwalk_job(int workerid, struct meter_worker_state *s, int dirfd)
+{
+	char prefix[PATH_MAX], path[PATH_MAX + 32];
+	struct open_how how;
+	uint64_t start;
+	int fd;
+
+	if (w_pathwalk_prefix(s->settings, prefix, sizeof(prefix)) != 0) {
+		printf("[%d] Can't build path: %s\n", workerid,
+		    strerror(errno));
+		return (-1);
+	}
+
+	memset(&how, 0, sizeof(how));
+	how.flags = w_pathwalk_params.opath ? O_PATH : O_RDONLY;
+	how.resolve = w_pathwalk_params.resolve;
+
+	for (long i = 0; meter_continue(s, i); i++) {
+		for (int k = 0; k < s->settings->file_count && !meter_stopped(s);
+		     k++) {
+			snprintf(path, sizeof(path), "%s/" FNAME, prefix, k);
+			start = meter_op_begin(s);
+			if (w_pathwalk_params.resolve == 0) {
+				fd = openat(w_pathwalk_params.base == ABS ?
+					AT_FDCWD : dirfd,
+				    path, how.flags);
+			} else {
+				fd = syscall(SYS_openat2, dirfd, path, &how,
+				    sizeof(how));
+				if (fd < 0 && errno == EAGAIN &&
+				    (how.resolve & RESOLVE_CACHED)) {
+					how.resolve &= ~RESOLVE_CACHED;
+					fd = syscall(SYS_openat2, dirfd, path,
+					    &how, sizeof(how));
+					how.resolve |= RESOLVE_CACHED;
+					s->my_stats->items++;
+				}
+			}
+			if (fd < 0) {
+				s->my_stats->errors++;
+				printf("[%d] Can't open file %s: %s\n",
+				    workerid, path, strerror(errno));
+				return (-1);
+			}
+			close(fd);
+			meter_op_end(s, start);
+		}
+	}
+	return (s->my_stats->ops);
+}
@@ -0,0 +1,8 @@
+#ifndef _W_PATHWALK_H_
+#define _W_PATHWALK_H_
+
+int w_pathwalk_option(char *);
+int w_pathwalk_init(struct meter_settings *, int);
+long w_pathwalk_job(int, struct meter_worker_state *, int);
+
+#endif /* !_W_PATHWALK_H_ */
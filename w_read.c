@@ -0,0 +1,331 @@
+#define _GNU_SOURCE
+#include <sys/param.h>
+#include <sys/uio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "syscallmeter.h"
+#include "uring.h"
+#include "w_read.h"
+
+#define BS_DEF 4096
+#define URING_QD_DEF 32
+#define DIRECT_ALIGN 4096
+#define IOV_MAX_DEF 64
+
+/*
+ * Pread - pread() of bs bytes
+ * Preadv - preadv() of bs bytes split into iov buffers
+ * Uring - IORING_OP_READ with qd reads kept in flight
+ *
+ * A cycle reads as many blocks as fit in one file. Sequential access
+ * walks the files block by block from a per-worker starting file, random
+ * access picks a file and a bs aligned offset for every block.
+ */
+enum w_read_engine { PREAD, PREADV, URING };
+
+typedef struct w_read_params {
+	enum w_read_engine engine;
+	size_t bs;
+	unsigned iov;
+	unsigned qd;
+	int direct; /* O_DIRECT with DIRECT_ALIGN aligned buffers */
+	int random;
+} w_read_params_t;
+
+static struct w_read_params w_read_params = { .engine = PREAD,
+	.bs = BS_DEF,
+	.iov = 1,
+	.qd = URING_QD_DEF,
+	.direct = 0,
+	.random = 0 };
+
+int
+w_read_option(char *option)
+{
+	char *end;
+
+	if (strcmp(option, "pread") == 0) {
+		w_read_params.engine = PREAD;
+	} else if (strcmp(option, "preadv") == 0) {
+		w_read_params.engine = PREADV;
+	} else if (strcmp(option, "uring") == 0) {
+		w_read_params.engine = URING;
+	} else if (strncmp(option, "bs=", 3) == 0) {
+		w_read_params.bs = strtoul(option + 3, &end, 10);
+		if (*end != '\0' || w_read_params.bs == 0) {
+			printf("invalid block size: %s\n", option);
+			return (-1);
+		}
+	} else if (strncmp(option, "iov=", 4) == 0) {
+		w_read_params.iov = strtoul(option + 4, &end, 10);
+		if (*end != '\0' || w_read_params.iov == 0 ||
+		    w_read_params.iov > IOV_MAX_DEF) {
+			printf("invalid number of iovecs: %s\n", option);
+			return (-1);
+		}
+	} else if (strncmp(option, "qd=", 3) == 0) {
+		w_read_params.qd = strtoul(option + 3, &end, 10);
+		if (*end != '\0' || w_read_params.qd == 0 ||
+		    w_read_params.qd > 4096) {
+			printf("invalid queue depth: %s\n", option);
+			return (-1);
+		}
+	} else if (strcmp(option, "direct") == 0) {
+		w_read_params.direct = 1;
+	} else if (strcmp(option, "seq") == 0) {
+		w_read_params.random = 0;
+	} else if (strcmp(option, "rand") == 0) {
+		w_read_params.random = 1;
+	} else {
+		printf("unexpected option: %s\n", option);
+		return (-1);
+	}
+	return (0);
+}
+
+int
+w_read_init(struct meter_settings *s, int dirfd)
+{
+	if (w_read_params.bs > s->file_size) {
+		printf("block size %zu is larger than file size %lu\n",
+		    w_read_params.bs, s->file_size);
+		return (-1);
+	}
+	if (w_read_params.direct && w_read_params.bs % 512 != 0) {
+		printf("block size %zu is not aligned for O_DIRECT\n",
+		    w_read_params.bs);
+		return (-1);
+	}
+	if (w_read_params.bs % w_read_params.iov != 0) {
+		printf("block size %zu is not divisible into %u iovecs\n",
+		    w_read_params.bs, w_read_params.iov);
+		return (-1);
+	}
+	/* Every iovec of an O_DIRECT preadv() must be aligned by itself */
+	if (w_read_params.direct &&
+	    (w_read_params.bs / w_read_params.iov) % 512 != 0) {
+		printf("iovecs of %zu bytes are not aligned for O_DIRECT\n",
+		    w_read_params.bs / w_read_params.iov);
+		return (-1);
+	}
+	/* Every worker keeps all the files open */
+	if (reserve_fds(s, s->file_count) != 0)
+		return (-1);
+
+	if (make_files(s, dirfd))
+		return (-1);
+	printf("Created files successfully\n");
+	return (0);
+}
+
+/* Position of the next block to read */
+typedef struct w_read_cursor {
+	unsigned int seed;
+	int file;
+	long block;
+	long blocks; /* Blocks in a file */
+} w_read_cursor_t;
+
+static void
+cursor_next(struct w_read_cursor *c, int nfiles, int *file, off_t *off)
+{
+	if (w_read_params.random) {
+		*file = rand_r(&c->seed) % nfiles;
+		*off = (off_t)(rand_r(&c->seed) % c->blocks) * w_read_params.bs;
+		return;
+	}
+
+	*file = c->file;
+	*off = (off_t)c->block * w_read_params.bs;
+	if (++c->block == c->blocks) {
+		c->block = 0;
+		c->file = (c->file + 1) % nfiles;
+	}
+}
+
+static char *
+alloc_buffer(size_t size)
+{
+	void *buf;
+
+	if (posix_memalign(&buf, DIRECT_ALIGN, size) != 0)
+		return (NULL);
+	memset(buf, 0, size);
+	return (buf);
+}
+
+static long
+w_read_sync_job(int workerid, struct meter_worker_state *s, int *fds,
+    struct w_read_cursor *c)
+{
+	struct iovec iov[IOV_MAX_DEF];
+	size_t part = w_read_params.bs / w_read_params.iov;
+	uint64_t start;
+	ssize_t res;
+	off_t off;
+	char *buf;
+	int file;
+
+	buf = alloc_buffer(w_read_params.bs);
+	if (buf == NULL) {
+		printf("[%d] Can't allocate buffer\n", workerid);
+		return (-1);
+	}
+	for (unsigned i = 0; i < w_read_params.iov; i++) {
+		iov[i].iov_base = buf + i * part;
+		iov[i].iov_len = part;
+	}
+
+	for (long i = 0; meter_continue(s, i); i++) {
+		for (long b = 0; b < c->blocks && !meter_stopped(s); b++) {
+			cursor_next(c, s->settings->file_count, &file, &off);
+			start = meter_op_begin(s);
+			if (w_read_params.engine == PREADV)
+				res = preadv(fds[file], iov, w_read_params.iov,
+				    off);
+			else
+				res = pread(fds[file], buf, w_read_params.bs,
+				    off);
+			meter_op_end(s, start);
+			if (res < 0)
+				s->my_stats->errors++;
+			else
+				s->my_stats->bytes += res;
+		}
+	}
+
+	free(buf);
+	return (s->my_stats->ops);
+}
+
+/* Keep qd reads in flight, every completion is replaced by a new read */
+static long
+w_read_uring_job(int workerid, struct meter_worker_state *s, int *fds,
+    struct w_read_cursor *c)
+{
+	struct meter_uring ring;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	uint64_t *starts;
+	unsigned qd, slot, inflight = 0;
+	long issued = 0, total;
+	char *bufs;
+	off_t off;
+	int file, err;
+
+	qd = w_read_params.qd;
+	err = uring_init(&ring, qd, 0);
+	if (err != 0) {
+		printf("[%d] Can't set up io_uring: %s\n", workerid,
+		    strerror(-err));
+		return (-1);
+	}
+	bufs = alloc_buffer(qd * w_read_params.bs);
+	starts = calloc(qd, sizeof(uint64_t));
+	if (bufs == NULL || starts == NULL) {
+		printf("[%d] Can't allocate buffers\n", workerid);
+		free(bufs);
+		free(starts);
+		uring_exit(&ring);
+		return (-1);
+	}
+
+	/* Iteration bound runs issue cycles * blocks reads in total */
+	total = s->settings->duration > 0 ? -1 :
+					     s->settings->cycles * c->blocks;
+	for (;;) {
+		while (inflight < qd && !meter_stopped(s) &&
+		    (total < 0 || issued < total)) {
+			slot = (unsigned)(issued % qd);
+			/* Slots complete out of order, find a free one */
+			while (starts[slot] != 0)
+				slot = (slot + 1) % qd;
+			cursor_next(c, s->settings->file_count, &file, &off);
+			starts[slot] = meter_op_begin(s);
+			sqe = uring_get_sqe(&ring);
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = fds[file];
+			sqe->off = off;
+			sqe->addr = (uint64_t)(uintptr_t)(bufs +
+			    slot * w_read_params.bs);
+			sqe->len = w_read_params.bs;
+			sqe->user_data = slot;
+			uring_submit(&ring, 0);
+			inflight++;
+			issued++;
+		}
+		if (inflight == 0)
+			break;
+
+		cqe = uring_wait_cqe(&ring);
+		if (cqe == NULL) {
+			printf("[%d] io_uring wait failed: %s\n", workerid,
+			    strerror(errno));
+			free(bufs);
+			free(starts);
+			uring_exit(&ring);
+			return (-1);
+		}
+		slot = (unsigned)cqe->user_data;
+		if (cqe->res < 0)
+			s->my_stats->errors++;
+		else
+			s->my_stats->bytes += cqe->res;
+		meter_op_record(s, vi_tmGetTicks() - starts[slot]);
+		starts[slot] = 0;
+		inflight--;
+		uring_cqe_seen(&ring);
+	}
+
+	free(bufs);
+	free(starts);
+	uring_exit(&ring);
+	return (s->my_stats->ops);
+}
+
+long
+w_read_job(int workerid, struct meter_worker_state *s, int dirfd)
+{
+	struct w_read_cursor c;
+	char filename[128];
+	int *fds, k, flags;
+	long ret = -1;
+
+	flags = O_RDONLY | (w_read_params.direct ? O_DIRECT : 0);
+	fds = malloc(s->settings->file_count * sizeof(int));
+	if (fds == NULL) {
+		printf("[%d] Can't allocate descriptors\n", workerid);
+		return (-1);
+	}
+	for (k = 0; k < s->settings->file_count; k++) {
+		sprintf(filename, FNAME, k);
+		fds[k] = openat(dirfd, filename, flags);
+		if (fds[k] < 0) {
+			printf("[%d] Can't open file %s: %s\n", workerid,
+			    filename, strerror(errno));
+			goto out;
+		}
+	}
+
+	c.seed = workerid;
+	c.file = workerid % s->settings->file_count;
+	c.block = 0;
+	c.blocks = s->settings->file_size / w_read_params.bs;
+
+	if (w_read_params.engine == URING)
+		ret = w_read_uring_job(workerid, s, fds, &c);
+	else
+		ret = w_read_sync_job(workerid, s, fds, &c);
+
+out:
+	while (k-- > 0)
+		close(fds[k]);
+	free(fds);
+	return (ret);
+}
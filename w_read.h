@@ -0,0 +1,9 @@
+#ifndef _W_READ_H_
+#define _W_READ_H_
+
+int w_read_option(char *);
+
+int w_read_init(struct meter_settings *, int);
+long w_read_job(int, struct meter_worker_state *, int);
+
+#endif /* !_W_READ_H_ */
@@ -0,0 +1,267 @@
+#define _GNU_SOURCE
+#include <sys/param.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "syscallmeter.h"
+#include "w_readdir.h"
+
+#define DIRNAME "readdir"
+#define CHURNNAME "churn_%d"
+#define BUFSIZE_DEF (32 * 1024)
+
+/*
+ * Readers list the whole directory every cycle with getdents64(), one
+ * operation per call that returns entries and one item per entry. The
+ * empty call that hits the end is not counted. The first 'churn'
+ * workers create and unlink a file in the same directory meanwhile and
+ * stop once every reader is done.
+ */
+typedef struct w_readdir_params {
+	int entries;	/* Directory size, -f when 0 */
+	size_t bufsize; /* getdents64() buffer */
+	int churn;	/* Workers changing the directory */
+} w_readdir_params_t;
+
+static struct w_readdir_params w_readdir_params = { .entries = 0,
+	.bufsize = BUFSIZE_DEF,
+	.churn = 0 };
+
+typedef struct w_readdir_shared {
+	int readers_left;
+} w_readdir_shared_t;
+
+static struct w_readdir_shared *w_readdir_state;
+
+int
+w_readdir_option(char *option)
+{
+	char *end;
+	long val;
+
+	if (strncmp(option, "entries=", 8) == 0) {
+		val = strtol(option + 8, &end, 10);
+		if (*end != '\0' || val <= 0 || val > INT32_MAX) {
+			printf("invalid number of entries: %s\n", option);
+			return (-1);
+		}
+		w_readdir_params.entries = val;
+	} else if (strncmp(option, "buf=", 4) == 0) {
+		val = strtol(option + 4, &end, 10);
+		/* The kernel needs room for at least one entry */
+		if (*end != '\0' || val < 512 || val > 64 * 1024 * 1024) {
+			printf("invalid buffer size: %s\n", option);
+			return (-1);
+		}
+		w_readdir_params.bufsize = val;
+	} else if (strncmp(option, "churn=", 6) == 0) {
+		val = strtol(option + 6, &end, 10);
+		if (*end != '\0' || val < 0 || val >= MAX_WORKERS) {
+			printf("invalid number of churn workers: %s\n", option);
+			return (-1);
+		}
+		w_readdir_params.churn = val;
+	} else {
+		printf("unexpected option: %s\n", option);
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Entries are empty files file_0 .. file_{count-1} and nothing else:
+ * missing ones are created, ones left by a run with more entries are
+ * removed. No manifest here, it would be listed as an entry too.
+ */
+static int
+w_readdir_populate(int fd, int count)
+{
+	char filename[128];
+	struct stat st;
+	int cfd;
+
+	for (int k = 0; k < count; k++) {
+		sprintf(filename, FNAME, k);
+		if (fstatat(fd, filename, &st, AT_SYMLINK_NOFOLLOW) == 0)
+			continue;
+		cfd = openat(fd, filename, O_CREAT | O_WRONLY, 0644);
+		if (cfd < 0) {
+			printf("Can't create file %s: %s\n", filename,
+			    strerror(errno));
+			return (-1);
+		}
+		close(cfd);
+	}
+	for (int k = count;; k++) {
+		sprintf(filename, FNAME, k);
+		if (unlinkat(fd, filename, 0) != 0) {
+			if (errno == ENOENT)
+				break;
+			printf("Can't remove file %s: %s\n", filename,
+			    strerror(errno));
+			return (-1);
+		}
+	}
+	/* Left by versions that made the entries with make_files() */
+	return (make_files_forget(fd));
+}
+
+int
+w_readdir_init(struct meter_settings *s, int dirfd)
+{
+	int count, fd;
+
+	w_readdir_state = mmap(0, sizeof(struct w_readdir_shared),
+	    PROT_READ | PROT_WRITE, MAP_ANON | MAP_SHARED, -1, 0);
+	if (w_readdir_state == MAP_FAILED)
+		return (-1);
+
+	if (mkdirat(dirfd, DIRNAME, 0775) != 0 && errno != EEXIST) {
+		printf("Can't create directory %s: %s\n", DIRNAME,
+		    strerror(errno));
+		return (-1);
+	}
+	fd = openat(dirfd, DIRNAME, O_RDONLY | O_DIRECTORY);
+	if (fd < 0) {
+		printf("Can't open directory %s: %s\n", DIRNAME,
+		    strerror(errno));
+		return (-1);
+	}
+
+	count = w_readdir_params.entries > 0 ? w_readdir_params.entries :
+					       s->file_count;
+	if (w_readdir_populate(fd, count) != 0) {
+		close(fd);
+		return (-1);
+	}
+	close(fd);
+	printf("Created directory of %d entries successfully\n", count);
+
+	return (0);
+}
+
+int
+w_readdir_reset(struct meter_settings *s, int dirfd)
+{
+	(void)dirfd;
+
+	if (s->ncpu <= w_readdir_params.churn) {
+		printf("%d churn workers leave no reader out of %ld workers\n",
+		    w_readdir_params.churn, s->ncpu);
+		return (-1);
+	}
+	w_readdir_state->readers_left = s->ncpu - w_readdir_params.churn;
+	return (0);
+}
+
+static long
+w_readdir_churn_job(int workerid, struct meter_worker_state *s, int fd)
+{
+	char filename[128];
+	long n = 0;
+	int cfd;
+
+	sprintf(filename, CHURNNAME, workerid);
+	while (__atomic_load_n(&w_readdir_state->readers_left,
+		   __ATOMIC_RELAXED) > 0 &&
+	    !meter_stopped(s)) {
+		cfd = openat(fd, filename, O_CREAT | O_RDWR, 0644);
+		if (cfd < 0) {
+			s->my_stats->errors++;
+			printf("[%d] Can't create file %s: %s\n", workerid,
+			    filename, strerror(errno));
+			return (-1);
+		}
+		close(cfd);
+		if (unlinkat(fd, filename, 0) != 0)
+			s->my_stats->errors++;
+		n++;
+	}
+	/* Create and unlink pairs, not accounted as operations */
+	return (n);
+}
+
+/* Number of entries in a getdents64() result */
+static long
+count_entries(const char *buf, ssize_t len)
+{
+	const struct dirent64 *d;
+	long n = 0;
+
+	for (ssize_t off = 0; off < len; off += d->d_reclen) {
+		d = (const struct dirent64 *)(buf + off);
+		n++;
+	}
+	return (n);
+}
+
+long
+w_readdir_job(int workerid, struct meter_worker_state *s, int dirfd)
+{
+	uint64_t start;
+	ssize_t len;
+	char *buf = NULL;
+	long ret = -1;
+	int fd;
+
+	fd = openat(dirfd, DIRNAME, O_RDONLY | O_DIRECTORY);
+	if (fd < 0) {
+		printf("[%d] Can't open directory %s: %s\n", workerid, DIRNAME,
+		    strerror(errno));
+		goto done;
+	}
+
+	if (workerid < w_readdir_params.churn) {
+		ret = w_readdir_churn_job(workerid, s, fd);
+		close(fd);
+		return (ret);
+	}
+
+	buf = malloc(w_readdir_params.bufsize);
+	if (buf == NULL) {
+		printf("[%d] Can't allocate buffer\n", workerid);
+		goto done;
+	}
+
+	for (long i = 0; meter_continue(s, i); i++) {
+		if (lseek(fd, 0, SEEK_SET) != 0) {
+			s->my_stats->errors++;
+			break;
+		}
+		do {
+			start = meter_op_begin(s);
+			len = getdents64(fd, buf, w_readdir_params.bufsize);
+			/* The empty read at the end of the directory is no op */
+			if (len == 0)
+				break;
+			if (len < 0) {
+				s->my_stats->errors++;
+				break;
+			}
+			meter_op_end(s, start);
+			if (meter_measuring(s)) {
+				s->my_stats->items += count_entries(buf, len);
+				s->my_stats->bytes += len;
+			}
+		} while (!meter_stopped(s));
+	}
+	ret = s->my_stats->ops;
+
+done:
+	/* Churn workers spin until every reader is gone, failed ones too */
+	if (workerid >= w_readdir_params.churn)
+		__atomic_sub_fetch(&w_readdir_state->readers_left, 1,
+		    __ATOMIC_RELAXED);
+	free(buf);
+	if (fd >= 0)
+		close(fd);
+	return (ret);
+}
@@ -0,0 +1,10 @@
+#ifndef _W_READDIR_H_
+#define _W_READDIR_H_
+
+int w_readdir_option(char *);
+
+int w_readdir_init(struct meter_settings *, int);
+int w_readdir_reset(struct meter_settings *, int);
+long w_readdir_job(int, struct meter_worker_state *, int);
+
+#endif /* !_W_READDIR_H_ */
@@ -1,69 +1,311 @@
+#define _GNU_SOURCE
+#include <sys/stat.h>
+
 #include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "syscallmeter.h"
 #include "w_rename.h"
 
+#define DIRNAME "rename"
+#define TMPNAME "tmp_%d"
+
+/*
+ * Every operation moves a file of the worker's slice from its home name
+ * file_N to the away name file_{N+file_count} and back on the next pass.
+ * Plain - renameat(), the target never exists
+ * NoReplace - renameat2(RENAME_NOREPLACE)
+ * Exchange - renameat2(RENAME_EXCHANGE), both names exist
+ * Overwrite - a new temporary file is renamed over file_N, the atomic
+ *             replace used to publish configs (creation is not timed)
+ */
+enum w_rename_op { REN_PLAIN, REN_NOREPLACE, REN_EXCHANGE, REN_OVERWRITE };
+
+/*
+ * Shared - files of all workers in one directory, i_rwsem of the directory
+ *          is the contention point
+ * PerWorker - a directory per worker, leaves only the global locks
+ */
+enum w_rename_dirs { DIRS_SHARED, DIRS_PERWORKER };
+
+typedef struct w_rename_params {
+	enum w_rename_op op;
+	enum w_rename_dirs dirs;
+	/*
+	 * Away names live in a second directory, so renames take
+	 * s_vfs_rename_mutex of the filesystem. Combines with either dirs.
+	 */
+	int crossdir;
+} w_rename_params_t;
+
+static struct w_rename_params w_rename_params = { .op = REN_PLAIN,
+	.dirs = DIRS_SHARED,
+	.crossdir = 0 };
+
+/*
+ * The historical variant (plain, shared, same directory) renames the
+ * dataset of make_files() in place. Every other one gets a tree of empty
+ * files under DIRNAME, laid out again for every run.
+ */
+static int
+w_rename_tree(void)
+{
+	return (w_rename_params.op != REN_PLAIN ||
+	    w_rename_params.dirs != DIRS_SHARED || w_rename_params.crossdir);
+}
+
+int
+w_rename_option(char *option)
+{
+	if (strcmp(option, "plain") == 0) {
+		w_rename_params.op = REN_PLAIN;
+	} else if (strcmp(option, "noreplace") == 0) {
+		w_rename_params.op = REN_NOREPLACE;
+	} else if (strcmp(option, "exchange") == 0) {
+		w_rename_params.op = REN_EXCHANGE;
+	} else if (strcmp(option, "overwrite") == 0) {
+		w_rename_params.op = REN_OVERWRITE;
+	} else if (strcmp(option, "shared") == 0) {
+		w_rename_params.dirs = DIRS_SHARED;
+	} else if (strcmp(option, "perworker") == 0) {
+		w_rename_params.dirs = DIRS_PERWORKER;
+	} else if (strcmp(option, "crossdir") == 0) {
+		w_rename_params.crossdir = 1;
+	} else {
+		printf("unexpected option: %s\n", option);
+		return (-1);
+	}
+	return (0);
+}
+
+/* Home and away directories of a worker relative to DIRNAME */
+static void
+w_rename_dirnames(int workerid, char *home, char *away, size_t len)
+{
+	if (w_rename_params.dirs == DIRS_PERWORKER) {
+		snprintf(home, len, "a%d", workerid);
+		snprintf(away, len, "b%d", workerid);
+	} else {
+		snprintf(home, len, "a");
+		snprintf(away, len, "b");
+	}
+	if (!w_rename_params.crossdir)
+		snprintf(away, len, "%s", home);
+}
+
+static int
+w_rename_unlink(const char *path, const struct stat *sb, int type,
+    struct FTW *ftw)
+{
+	(void)sb;
+	(void)type;
+
+	if (ftw->level == 0)
+		return (0);
+	return (remove(path) != 0 ? -1 : 0);
+}
+
+static int
+w_rename_touch(int dirfd, const char *name)
+{
+	int fd;
+
+	fd = openat(dirfd, name, O_CREAT | O_WRONLY, 0644);
+	if (fd < 0) {
+		printf("Can't create file %s: %s\n", name, strerror(errno));
+		return (-1);
+	}
+	close(fd);
+	return (0);
+}
+
+static int
+w_rename_mkdir(int dirfd, const char *name)
+{
+	int fd;
+
+	if (mkdirat(dirfd, name, 0775) != 0 && errno != EEXIST) {
+		printf("Can't create directory %s: %s\n", name,
+		    strerror(errno));
+		return (-1);
+	}
+	fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		printf("Can't open directory %s: %s\n", name, strerror(errno));
+	return (fd);
+}
+
 int
 w_rename_init(struct meter_settings *s, int dirfd)
 {
+	if (w_rename_tree())
+		return (0);
+
 	if (make_files(s, dirfd))
 		return (-1);
 	printf("Created files successfully\n");
 	return (0);
 }
 
+/* Slices depend on the number of workers, so the tree is made per run */
+int
+w_rename_reset(struct meter_settings *s, int dirfd)
+{
+	char path[PATH_MAX], home[32], away[32], name[128];
+	int treefd, homefd, awayfd, err = 0;
+	int per_worker = s->file_count / s->ncpu;
+
+	if (!w_rename_tree())
+		return (0);
+
+	snprintf(path, sizeof(path), "%s/%s", s->temp_dir, DIRNAME);
+	if (nftw(path, w_rename_unlink, 16, FTW_DEPTH | FTW_PHYS) != 0 &&
+	    errno != ENOENT) {
+		printf("Can't clean up %s: %s\n", path, strerror(errno));
+		return (-1);
+	}
+	treefd = w_rename_mkdir(dirfd, DIRNAME);
+	if (treefd < 0)
+		return (-1);
+
+	for (int w = 0; w < s->ncpu && err == 0; w++) {
+		w_rename_dirnames(w, home, away, sizeof(home));
+		homefd = w_rename_mkdir(treefd, home);
+		awayfd = w_rename_mkdir(treefd, away);
+		if (homefd < 0 || awayfd < 0)
+			err = -1;
+		for (int id = per_worker * w;
+		     err == 0 && id < per_worker * (w + 1); id++) {
+			sprintf(name, FNAME, id);
+			err = w_rename_touch(homefd, name);
+			if (err == 0 && w_rename_params.op == REN_EXCHANGE) {
+				sprintf(name, FNAME, id + s->file_count);
+				err = w_rename_touch(awayfd, name);
+			}
+		}
+		if (homefd >= 0)
+			close(homefd);
+		if (awayfd >= 0)
+			close(awayfd);
+	}
+	close(treefd);
+	if (err == 0)
+		printf("Created rename tree of %d files successfully\n",
+		    per_worker * (int)s->ncpu);
+	return (err);
+}
+
+/* Move file_id from the home to the away name (back from away when set) */
+static int
+w_rename_one(struct meter_worker_state *s, int homefd, int awayfd,
+    int file_id, int back)
+{
+	char homename[128], awayname[128], tmpname[128];
+	const char *from, *to;
+	int fd, res;
+	uint64_t start;
+
+	sprintf(homename, FNAME, file_id);
+	sprintf(awayname, FNAME, file_id + s->settings->file_count);
+	from = back ? awayname : homename;
+	to = back ? homename : awayname;
+
+	switch (w_rename_params.op) {
+	case REN_OVERWRITE:
+		sprintf(tmpname, TMPNAME, file_id);
+		fd = openat(awayfd, tmpname, O_CREAT | O_WRONLY | O_TRUNC,
+		    0644);
+		if (fd < 0) {
+			s->my_stats->errors++;
+			printf("[%d] Can't create file %s: %s\n", s->id,
+			    tmpname, strerror(errno));
+			return (-1);
+		}
+		close(fd);
+		from = tmpname;
+		to = homename;
+		start = meter_op_begin(s);
+		res = renameat(awayfd, tmpname, homefd, homename);
+		break;
+	case REN_NOREPLACE:
+		start = meter_op_begin(s);
+		res = renameat2(back ? awayfd : homefd, from,
+		    back ? homefd : awayfd, to, RENAME_NOREPLACE);
+		break;
+	case REN_EXCHANGE:
+		/* Both names exist, a pass swaps them and the next one back */
+		start = meter_op_begin(s);
+		res = renameat2(homefd, homename, awayfd, awayname,
+		    RENAME_EXCHANGE);
+		break;
+	default:
+		start = meter_op_begin(s);
+		res = renameat(back ? awayfd : homefd, from,
+		    back ? homefd : awayfd, to);
+		break;
+	}
+	if (res) {
+		s->my_stats->errors++;
+		printf("[%d] Can't rename file %s to %s: %s\n", s->id, from,
+		    to, strerror(errno));
+		return (-1);
+	}
+	meter_op_end(s, start);
+	return (0);
+}
+
 long
 w_rename_job(int workerid, struct meter_worker_state *s, int dirfd)
 {
-	int renameRes;
-	char filename[128];
-	char newfilename[128];
+	char home[32], away[32];
+	int treefd, homefd, awayfd;
+	long ret = -1;
 
 	int file_id_start = (s->settings->file_count / s->settings->ncpu) *
 	    workerid;
 	int file_id_end = (s->settings->file_count / s->settings->ncpu) *
 	    (workerid + 1);
 
-	if (fchdir(dirfd)) {
-		printf("[%d] Can't change dir: %s\n", workerid,
-		    strerror(errno));
-		return (-1);
-	}
-
-	for (long i = 0; i < s->settings->cycles; i++) {
-		for (int file_id = file_id_start; file_id < file_id_end;
-		    file_id++) {
-			sprintf(filename, FNAME, file_id);
-			sprintf(newfilename, FNAME,
-			    file_id + s->settings->file_count);
-			renameRes = rename(filename, newfilename);
-			if (renameRes) {
-				printf("[%d] Can't rename file %s to %s: %s",
-				    workerid, filename, newfilename,
-				    strerror(errno));
-				return (-1);
-			}
-			s->my_stats->cycles++;
+	homefd = awayfd = dirfd;
+	if (w_rename_tree()) {
+		w_rename_dirnames(workerid, home, away, sizeof(home));
+		treefd = openat(dirfd, DIRNAME, O_RDONLY | O_DIRECTORY);
+		homefd = openat(treefd, home, O_RDONLY | O_DIRECTORY);
+		awayfd = openat(treefd, away, O_RDONLY | O_DIRECTORY);
+		close(treefd);
+		if (homefd < 0 || awayfd < 0) {
+			printf("[%d] Can't open rename directories: %s\n",
+			    workerid, strerror(errno));
+			goto done;
 		}
+	}
 
-		for (int file_id = file_id_start + s->settings->file_count;
-		    file_id < file_id_end + s->settings->file_count;
-		    file_id++) {
-			sprintf(filename, FNAME, file_id);
-			sprintf(newfilename, FNAME,
-			    file_id - s->settings->file_count);
-			renameRes = rename(filename, newfilename);
-			if (renameRes) {
-				printf("[%d] Can't rename file %s to %s: %s",
-				    workerid, filename, newfilename,
-				    strerror(errno));
-				return (-1);
+	/* renameat() instead of fchdir() + rename(): cwd is per process */
+	/* Stop only after full cycles, so that files get their names back */
+	for (long i = 0; meter_continue(s, i); i++) {
+		for (int back = 0; back < 2; back++) {
+			/* A replaced file needs no way back */
+			if (back && w_rename_params.op == REN_OVERWRITE)
+				break;
+			for (int file_id = file_id_start;
+			     file_id < file_id_end; file_id++) {
+				if (w_rename_one(s, homefd, awayfd, file_id,
+					back) != 0)
+					goto done;
 			}
-			s->my_stats->cycles++;
 		}
 	}
-	return (s->my_stats->cycles);
+	ret = s->my_stats->ops;
+done:
+	if (homefd >= 0 && homefd != dirfd)
+		close(homefd);
+	if (awayfd >= 0 && awayfd != dirfd)
+		close(awayfd);
+	return (ret);
 }
@@ -1,7 +1,9 @@
 #ifndef _W_RENAME_H_
 #define _W_RENAME_H_
 
+int w_rename_option(char *);
 int w_rename_init(struct meter_settings *, int);
+int w_rename_reset(struct meter_settings *, int);
 long w_rename_job(int, struct meter_worker_state *, int);
 
 #endif /* !_W_RENAME_H_ */
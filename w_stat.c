@@ -0,0 +1,185 @@
+#define _GNU_SOURCE
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "syscallmeter.h"
+#include "w_stat.h"
+
+#define NEGNAME "nofile_%d"
+
+/*
+ * Fstatat - fstatat() of every file by name relative to -d
+ * Statx - statx() of every file by name with the selected mask
+ * Fstat - fstat() of descriptors opened before the run, no lookup at all
+ */
+enum w_stat_call { FSTATAT, STATX, FSTAT };
+
+typedef struct w_stat_params {
+	enum w_stat_call call;
+	unsigned int mask; /* statx() fields requested */
+	int sync_flags;	   /* AT_STATX_DONT_SYNC or AT_STATX_FORCE_SYNC */
+	int negative;	   /* Look up names which do not exist */
+} w_stat_params_t;
+
+static struct w_stat_params w_stat_params = { .call = FSTATAT,
+	.mask = STATX_BASIC_STATS,
+	.sync_flags = 0,
+	.negative = 0 };
+
+static int
+w_stat_mask(const char *name, unsigned int *mask)
+{
+	char *end;
+
+	if (strcmp(name, "type") == 0) {
+		*mask = STATX_TYPE;
+	} else if (strcmp(name, "size") == 0) {
+		*mask = STATX_SIZE;
+	} else if (strcmp(name, "basic") == 0) {
+		*mask = STATX_BASIC_STATS;
+	} else if (strcmp(name, "btime") == 0) {
+		*mask = STATX_BTIME;
+	} else if (strcmp(name, "all") == 0) {
+		*mask = STATX_ALL;
+	} else {
+		*mask = strtoul(name, &end, 0);
+		if (*name == '\0' || *end != '\0')
+			return (-1);
+	}
+	return (0);
+}
+
+int
+w_stat_option(char *option)
+{
+	if (strcmp(option, "fstatat") == 0) {
+		w_stat_params.call = FSTATAT;
+	} else if (strcmp(option, "statx") == 0) {
+		w_stat_params.call = STATX;
+	} else if (strcmp(option, "fstat") == 0) {
+		w_stat_params.call = FSTAT;
+	} else if (strncmp(option, "mask=", 5) == 0) {
+		if (w_stat_mask(option + 5, &w_stat_params.mask) != 0) {
+			printf("invalid statx mask: %s\n", option);
+			return (-1);
+		}
+	} else if (strcmp(option, "dontsync") == 0) {
+		w_stat_params.sync_flags = AT_STATX_DONT_SYNC;
+	} else if (strcmp(option, "forcesync") == 0) {
+		w_stat_params.sync_flags = AT_STATX_FORCE_SYNC;
+	} else if (strcmp(option, "negative") == 0) {
+		w_stat_params.negative = 1;
+	} else {
+		printf("unexpected option: %s\n", option);
+		return (-1);
+	}
+	return (0);
+}
+
+int
+w_stat_init(struct meter_settings *s, int dirfd)
+{
+	if (w_stat_params.call == FSTAT && w_stat_params.negative) {
+		printf("option negative needs a lookup, not fstat\n");
+		return (-1);
+	}
+	if (w_stat_params.call != STATX &&
+	    (w_stat_params.sync_flags != 0 ||
+		w_stat_params.mask != STATX_BASIC_STATS))
+		printf("Warning! statx mask and sync options need statx\n");
+	if (w_stat_params.call == FSTAT &&
+	    reserve_fds(s, s->file_count) != 0)
+		return (-1);
+
+	if (make_files(s, dirfd))
+		return (-1);
+	printf("Created files successfully\n");
+	return (0);
+}
+
+/* Every worker holds its own descriptor of every file */
+static long
+w_stat_fstat_job(int workerid, struct meter_worker_state *s, int dirfd)
+{
+	char filename[128];
+	struct stat st;
+	uint64_t start;
+	int *fds;
+	long ret = -1;
+	int k, n = s->settings->file_count;
+
+	fds = malloc(n * sizeof(int));
+	if (fds == NULL) {
+		printf("[%d] Can't allocate descriptors\n", workerid);
+		return (-1);
+	}
+	for (k = 0; k < n; k++) {
+		sprintf(filename, FNAME, k);
+		fds[k] = openat(dirfd, filename, O_RDONLY);
+		if (fds[k] < 0) {
+			printf("[%d] Can't open file %s: %s\n", workerid,
+			    filename, strerror(errno));
+			goto out;
+		}
+	}
+
+	for (long i = 0; meter_continue(s, i); i++) {
+		for (int j = 0; j < n && !meter_stopped(s); j++) {
+			start = meter_op_begin(s);
+			if (fstat(fds[j], &st) != 0)
+				s->my_stats->errors++;
+			meter_op_end(s, start);
+		}
+	}
+	ret = s->my_stats->ops;
+
+out:
+	while (k-- > 0)
+		close(fds[k]);
+	free(fds);
+	return (ret);
+}
+
+long
+w_stat_job(int workerid, struct meter_worker_state *s, int dirfd)
+{
+	char filename[128];
+	struct stat st;
+	struct statx stx;
+	uint64_t start;
+	int res, flags;
+
+	if (w_stat_params.call == FSTAT)
+		return (w_stat_fstat_job(workerid, s, dirfd));
+
+	flags = AT_SYMLINK_NOFOLLOW | w_stat_params.sync_flags;
+	for (long i = 0; meter_continue(s, i); i++) {
+		for (int k = 0; k < s->settings->file_count && !meter_stopped(s);
+		     k++) {
+			sprintf(filename, w_stat_params.negative ? NEGNAME : FNAME,
+			    k);
+			start = meter_op_begin(s);
+			if (w_stat_params.call == STATX)
+				res = statx(dirfd, filename, flags,
+				    w_stat_params.mask, &stx);
+			else
+				res = fstatat(dirfd, filename, &st,
+				    AT_SYMLINK_NOFOLLOW);
+			meter_op_end(s, start);
+
+			/* A negative lookup is expected to miss */
+			if (w_stat_params.negative ?
+				(res == 0 || errno != ENOENT) :
+				res != 0)
+				s->my_stats->errors++;
+		}
+	}
+	return (s->my_stats->ops);
+}
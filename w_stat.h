@@ -0,0 +1,9 @@
+#ifndef _W_STAT_H_
+#define _W_STAT_H_
+
+int w_stat_option(char *);
+
+int w_stat_init(struct meter_settings *, int);
+long w_stat_job(int, struct meter_worker_state *, int);
+
+#endif /* !_W_STAT_H_ */
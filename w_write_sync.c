@@ -1,16 +1,22 @@
 #define _GNU_SOURCE
 #include <sys/param.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 
 #include <errno.h>
 #include <fcntl.h>
-#include <semaphore.h>
+#include <limits.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "futex.h"
+#include "lock.h"
 #include "syscallmeter.h"
+#include "uring.h"
 #include "w_write_sync.h"
 #include <x86intrin.h>
 #define CHUNKSIZE 64 * 1024
@@ -21,40 +27,33 @@
  * Dual - separate locks for write and sync
  * OnlyWrite - lock for write and no lock for sync
  * ExWr_ShSy - exclusive lock for write and shared lock for sync
+ * Uring - lock only to reserve a range, then linked WRITE -> FSYNC through
+ *         io_uring with several commits in flight per worker
+ * GroupCommit - requests are pushed to a lock-free stack, one leader writes
+ *         all pending ones with pwritev() + fdatasync(), followers sleep
+ *         on a futex until their request is durable
+ * Syncer - workers only write under the lock, a separate syncer process
+ *         flushes whatever was written and wakes them through a futex
  */
-enum w_lockmode { JOINED, DUAL, ONLYWRITE, EXWR_SHSY };
-
-#define DO_LOCK(_p)                                                                \
-	do {                                                                       \
-		err = sem_wait((_p));                                              \
-		if (err != 0) {                                                    \
-			switch (err) {                                             \
-			case EINVAL:                                               \
-				printf(                                            \
-				    "The argument points to invalid semaphore\n"); \
-				exit(-1);                                          \
-			case EINTR:                                                \
-				exit(-1);                                          \
-			}                                                          \
-		}                                                                  \
-	} while (1 == 0);
+enum w_lockmode {
+	JOINED,
+	DUAL,
+	ONLYWRITE,
+	EXWR_SHSY,
+	URING,
+	GROUPCOMMIT,
+	SYNCER
+};
 
-#define DO_UNLOCK(_p)                                                              \
-	do {                                                                       \
-		err = sem_post((_p));                                              \
-		if (err != 0) {                                                    \
-			switch (err) {                                             \
-			case EINVAL:                                               \
-				printf(                                            \
-				    "The argument points to invalid semaphore\n"); \
-				exit(-1);                                          \
-			case EOVERFLOW:                                            \
-				printf("Unexpected overflow of semaphore\n");      \
-				exit(-1);                                          \
-			}                                                          \
-		}                                                                  \
+#define DO_LOCK(_p, _phase)                             \
+	do {                                            \
+		uint64_t _wait = lock_acquire((_p), s); \
+		meter_lock_wait(s, _wait);              \
+		phase_record(s, (_phase), _wait);       \
 	} while (1 == 0);
 
+#define DO_UNLOCK(_p) lock_release((_p), s)
+
 #define DO_WORK(_p)                                             \
 	do {                                                    \
 		unsigned long long start, end;                  \
@@ -65,26 +64,123 @@ enum w_lockmode { JOINED, DUAL, ONLYWRITE, EXWR_SHSY };
 		} while ((end - start) < wait_cycles);          \
 	} while (1 == 0);
 
+/* Commit request of a worker in GROUPCOMMIT mode */
+enum gc_state { GC_PENDING, GC_DONE, GC_EXHAUSTED };
+
+typedef struct gc_slot {
+	uint32_t next;	 /* Stack link: slot index + 1, 0 ends the stack */
+	uint32_t state;	 /* enum gc_state, set by the leader */
+	unsigned long len; /* Bytes to append */
+} __attribute__((aligned(CACHELINE_SIZE))) gc_slot_t;
+
 typedef struct workers_sharedmem {
-	sem_t mx_write;
-	sem_t mx_sync;
+	struct meter_lock *mx_write;
+	struct meter_lock *mx_sync;
 	unsigned long position_write;
 	unsigned long position_sync;
+
+	/* GROUPCOMMIT */
+	uint32_t gc_head __attribute__((aligned(CACHELINE_SIZE)));
+	uint32_t gc_leader __attribute__((aligned(CACHELINE_SIZE)));
+	uint32_t sync_seq __attribute__((aligned(CACHELINE_SIZE)));
+	struct gc_slot gc_slots[MAX_WORKERS];
+
+	/* SYNCER */
+	uint32_t write_seq __attribute__((aligned(CACHELINE_SIZE)));
+	uint32_t syncer_sleeping;
+	uint32_t workers_done;
+	uint32_t syncer_stop; /* Set by the parent once workers are gone */
 } workers_sharedmem_t;
 
+/*
+ * Phases of a commit, timed separately
+ * WLock, SLock - waiting for mx_write, mx_sync
+ * Write - pwrite() or the batch pwritev() of a leader
+ * Flush - the sync call issued by this worker
+ * Wait - waiting for a flush issued by someone else (leader, syncer,
+ *        io_uring completion)
+ */
+enum w_phase { PH_WLOCK, PH_SLOCK, PH_WRITE, PH_FLUSH, PH_WAIT, PH_COUNT };
+
+static const char *w_phase_names[PH_COUNT] = { "write lock", "sync lock",
+	"write", "flush", "flush wait" };
+
+/* Per worker, measured window only */
+typedef struct w_phase_stats {
+	struct meter_histo histo[PH_COUNT];
+	uint64_t commits;
+	uint64_t skipped; /* Made durable by someone else's flush */
+} __attribute__((aligned(CACHELINE_SIZE))) w_phase_stats_t;
+
+/*
+ * State of the log segments when a run starts
+ * Recycle - fully written by make_files(), overwritten in place
+ * Append - empty, every write extends the file
+ * Fallocate - empty with preallocated (unwritten) extents
+ * Zero - filled with zeros and synced, like a freshly initialised WAL
+ */
+enum w_segmode { SEG_RECYCLE, SEG_APPEND, SEG_FALLOCATE, SEG_ZERO };
+
+/*
+ * How a commit is made durable
+ * Fdatasync, Fsync - write, then the sync call
+ * ODsync - segments opened with O_DSYNC, every write is durable
+ * RwfDsync - pwritev2(RWF_DSYNC) per write
+ * SyncRange - sync_file_range() write-behind after every write, so that
+ *             the final fdatasync() has less left to do
+ */
+enum w_durability { DUR_FDATASYNC, DUR_FSYNC, DUR_ODSYNC, DUR_RWFDSYNC,
+	DUR_SYNCRANGE };
+
 /* Global variables - constant over time */
 typedef struct workers_test_params {
 	enum w_lockmode w_mode;
 	int sync_concurrency;
 	int direct;
 	int shift_position;
+	int uring_qd; /* Commits in flight per worker for URING */
+	long syncer_delay_us; /* SYNCER pause between flushes, 0 to flush ASAP */
+	enum w_segmode seg_mode;
+	int preopen; /* Open the next segment ahead, off the locked path */
+	enum w_durability durability;
+	enum meter_lock_kind lock_kind; /* Of mx_write, and mx_sync if exclusive */
 } workers_test_params_t;
 
+/* Job state: s->opaque points to the worker's w_phases slot */
+static inline void
+phase_record(struct meter_worker_state *s, enum w_phase phase,
+    uint64_t ticks)
+{
+	struct w_phase_stats *ps = s->opaque;
+
+	if (meter_measuring(s))
+		histo_record(&ps->histo[phase], ticks);
+}
+
+static inline void
+phase_commit(struct meter_worker_state *s, int skipped)
+{
+	struct w_phase_stats *ps = s->opaque;
+
+	if (!meter_measuring(s))
+		return;
+	ps->commits++;
+	if (skipped)
+		ps->skipped++;
+}
+
 struct workers_sharedmem *w_state = NULL;
+struct w_phase_stats *w_phases = NULL;
 struct workers_test_params w_params = { .sync_concurrency = 1,
 	.w_mode = JOINED,
 	.direct = 0,
-	.shift_position = 0 };
+	.shift_position = 0,
+	.uring_qd = 4,
+	.syncer_delay_us = 0,
+	.seg_mode = SEG_RECYCLE,
+	.preopen = 0,
+	.durability = DUR_FDATASYNC,
+	.lock_kind = LOCK_SEM };
 
 #define WORKER_FILE_INDEX(_s) (w_state->position_write / _s->settings->file_size)
 #define WORKER_FILE_INDEX_SYNC(_pos,_s) (_pos / _s->settings->file_size)
@@ -118,6 +214,122 @@ update_fsync_pos(unsigned long new_pos)
 	while (current < new_pos && !pg_atomic_compare_exchange_u64_impl(&w_state->position_sync, &current, new_pos));
 }
 
+static inline int
+open_segment(int dirfd, int index, int flags)
+{
+	char filename[128];
+
+	sprintf(filename, FNAME, index);
+	return (openat(dirfd, filename, flags, 0644));
+}
+
+static inline int
+segment_flags(void)
+{
+	return (O_CREAT | O_RDWR | (w_params.direct != 0 ? O_DIRECT : 0) |
+	    (w_params.durability == DUR_ODSYNC ? O_DSYNC : 0));
+}
+
+static ssize_t
+segment_writev(int fd, const struct iovec *iov, int iovcnt, off_t off)
+{
+	ssize_t res;
+
+	if (w_params.durability == DUR_RWFDSYNC)
+		return (pwritev2(fd, iov, iovcnt, off, RWF_DSYNC));
+
+	res = pwritev(fd, iov, iovcnt, off);
+	if (res > 0 && w_params.durability == DUR_SYNCRANGE)
+		(void)sync_file_range(fd, off, res, SYNC_FILE_RANGE_WRITE);
+	return (res);
+}
+
+static ssize_t
+segment_write(int fd, void *buf, size_t len, off_t off)
+{
+	struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+	return (segment_writev(fd, &iov, 1, off));
+}
+
+/* Make written data durable, a no-op when writes are durable already */
+static int
+segment_sync(int fd)
+{
+	switch (w_params.durability) {
+	case DUR_FSYNC:
+		return (fsync(fd));
+	case DUR_ODSYNC:
+	case DUR_RWFDSYNC:
+		return (0);
+	default:
+		return (fdatasync(fd));
+	}
+}
+
+/* Segment descriptor cache of a worker, with the next segment opened ahead */
+typedef struct w_segfd {
+	int dirfd;
+	int flags;
+	int index; /* Current segment */
+	int fd;
+	int next_index; /* Opened by segfd_preopen() */
+	int next_fd;
+} w_segfd_t;
+
+static void
+segfd_init(struct w_segfd *sf, int dirfd, int flags)
+{
+	sf->dirfd = dirfd;
+	sf->flags = flags;
+	sf->index = -1;
+	sf->fd = -1;
+	sf->next_index = -1;
+	sf->next_fd = -1;
+}
+
+static int
+segfd_get(struct w_segfd *sf, int index)
+{
+	if (sf->index == index)
+		return (sf->fd);
+
+	if (sf->fd >= 0)
+		close(sf->fd);
+	if (sf->next_index == index) {
+		sf->fd = sf->next_fd;
+		sf->next_index = -1;
+		sf->next_fd = -1;
+	} else {
+		sf->fd = open_segment(sf->dirfd, index, sf->flags);
+	}
+	sf->index = index;
+	return (sf->fd);
+}
+
+/* Called outside of the locks, so that crossing a segment costs no open() */
+static void
+segfd_preopen(struct w_segfd *sf, struct meter_settings *s)
+{
+	if (!w_params.preopen || sf->index < 0 ||
+	    sf->index + 1 >= s->file_count || sf->next_index == sf->index + 1)
+		return;
+
+	if (sf->next_fd >= 0)
+		close(sf->next_fd);
+	sf->next_index = sf->index + 1;
+	sf->next_fd = open_segment(sf->dirfd, sf->next_index, sf->flags);
+}
+
+static void
+segfd_close(struct w_segfd *sf)
+{
+	if (sf->fd >= 0)
+		close(sf->fd);
+	if (sf->next_fd >= 0)
+		close(sf->next_fd);
+	segfd_init(sf, sf->dirfd, sf->flags);
+}
 
 int
 w_write_sync_option(char *option)
@@ -134,6 +346,50 @@ w_write_sync_option(char *option)
 	} else if (strcmp(option, "sharesync16") == 0) {
 		w_params.w_mode = EXWR_SHSY;
 		w_params.sync_concurrency = 16;
+	} else if (strcmp(option, "uring") == 0) {
+		w_params.w_mode = URING;
+	} else if (strcmp(option, "groupcommit") == 0) {
+		w_params.w_mode = GROUPCOMMIT;
+	} else if (strcmp(option, "syncer") == 0) {
+		w_params.w_mode = SYNCER;
+	} else if (strncmp(option, "syncdelay=", 10) == 0) {
+		w_params.syncer_delay_us = strtol(option + 10, NULL, 10);
+		if (w_params.syncer_delay_us < 0 ||
+		    w_params.syncer_delay_us > 1000000) {
+			printf("invalid syncer delay: %s\n", option);
+			return -1;
+		}
+	} else if (strncmp(option, "qd=", 3) == 0) {
+		w_params.uring_qd = strtol(option + 3, NULL, 10);
+		if (w_params.uring_qd <= 0 || w_params.uring_qd > 256) {
+			printf("invalid queue depth: %s\n", option);
+			return -1;
+		}
+	} else if (strcmp(option, "recycle") == 0) {
+		w_params.seg_mode = SEG_RECYCLE;
+	} else if (strcmp(option, "append") == 0) {
+		w_params.seg_mode = SEG_APPEND;
+	} else if (strcmp(option, "fallocate") == 0) {
+		w_params.seg_mode = SEG_FALLOCATE;
+	} else if (strcmp(option, "zero") == 0) {
+		w_params.seg_mode = SEG_ZERO;
+	} else if (strncmp(option, "lock=", 5) == 0) {
+		if (lock_parse(option + 5, &w_params.lock_kind) != 0) {
+			printf("invalid lock: %s\n", option);
+			return -1;
+		}
+	} else if (strcmp(option, "preopen") == 0) {
+		w_params.preopen = 1;
+	} else if (strcmp(option, "fdatasync") == 0) {
+		w_params.durability = DUR_FDATASYNC;
+	} else if (strcmp(option, "fsync") == 0) {
+		w_params.durability = DUR_FSYNC;
+	} else if (strcmp(option, "odsync") == 0) {
+		w_params.durability = DUR_ODSYNC;
+	} else if (strcmp(option, "rwfdsync") == 0) {
+		w_params.durability = DUR_RWFDSYNC;
+	} else if (strcmp(option, "syncrange") == 0) {
+		w_params.durability = DUR_SYNCRANGE;
 	} else if (strcmp(option, "direct") == 0) {
 		w_params.direct = 1;
 	} else if (strcmp(option, "doublelast") == 0) {
@@ -145,9 +401,31 @@ w_write_sync_option(char *option)
 	return (0);
 }
 
+#define URING_ENTRIES_MAX 4096
+
+/*
+ * SQ entries of the URING mode: up to three SQEs per segment, a commit
+ * spans at most this many segments. A commit is one linked chain, it
+ * can not be split across submits, so all of them must fit.
+ */
+static unsigned
+uring_entries(struct meter_settings *s)
+{
+	return (w_params.uring_qd * 3 * (2 * CHUNKSIZE / s->file_size + 2));
+}
+
 int
 w_write_sync_init(struct meter_settings *s, int dirfd)
 {
+	if (w_params.w_mode == URING &&
+	    uring_entries(s) > URING_ENTRIES_MAX) {
+		printf("qd=%d needs %u SQEs with -s %lu, more than %d: "
+		       "lower qd or raise -s\n",
+		    w_params.uring_qd, uring_entries(s), s->file_size,
+		    URING_ENTRIES_MAX);
+		return (-1);
+	}
+
 	w_state = mmap(0, sizeof(struct workers_sharedmem),
 	    PROT_READ | PROT_WRITE, MAP_ANON | MAP_SHARED, -1, 0);
 
@@ -155,55 +433,880 @@ w_write_sync_init(struct meter_settings *s, int dirfd)
 		return (-1);
 	}
 
+	w_phases = mmap(0, sizeof(struct w_phase_stats) * MAX_WORKERS,
+	    PROT_READ | PROT_WRITE, MAP_ANON | MAP_SHARED, -1, 0);
+	if (w_phases == MAP_FAILED) {
+		return (-1);
+	}
+
 	w_state->position_write = 0;
 	w_state->position_sync = 0;
 
-	sem_init(&w_state->mx_write, 1, 1);
-	sem_init(&w_state->mx_sync, 1, w_params.sync_concurrency);
+	/* Only a semaphore admits several sync holders (sharesync) */
+	w_state->mx_write = lock_create("mx_write", w_params.lock_kind, 1);
+	w_state->mx_sync = lock_create("mx_sync",
+	    w_params.sync_concurrency > 1 ? LOCK_SEM : w_params.lock_kind,
+	    w_params.sync_concurrency);
+	if (w_state->mx_write == NULL || w_state->mx_sync == NULL) {
+		printf("Can't create locks: %s\n", strerror(errno));
+		return (-1);
+	}
+
+	/* Other segment modes are laid out before every run by reset */
+	if (w_params.seg_mode == SEG_RECYCLE) {
+		if (make_files(s, dirfd))
+			return (-1);
+		printf("Created files successfully\n");
+	}
+
+	return (0);
+}
 
-	if (make_files(s, dirfd))
+#define ZERO_CHUNK (1024 * 1024)
+
+/* Bring every segment to the state of the segment mode, made durable */
+static int
+prepare_segments(struct meter_settings *s, int dirfd)
+{
+	char *zeros = NULL;
+	size_t done, n;
+	int fd, err = 0;
+
+	if (w_params.seg_mode == SEG_RECYCLE)
+		return (0);
+	/* Segments stop being the --data dataset once they are changed */
+	if (make_files_forget(dirfd) != 0)
 		return (-1);
-	printf("Created files successfully\n");
+
+	if (w_params.seg_mode == SEG_ZERO) {
+		zeros = calloc(1, ZERO_CHUNK);
+		if (zeros == NULL)
+			return (-1);
+	}
+
+	for (int i = 0; i < s->file_count && err == 0; i++) {
+		fd = open_segment(dirfd, i, O_CREAT | O_RDWR);
+		if (fd < 0 || ftruncate(fd, 0) != 0) {
+			printf("Can't prepare segment %d: %s\n", i,
+			    strerror(errno));
+			err = -1;
+			break;
+		}
+
+		switch (w_params.seg_mode) {
+		case SEG_FALLOCATE:
+			err = fallocate(fd, 0, 0, s->file_size);
+			break;
+		case SEG_ZERO:
+			for (done = 0; done < s->file_size && err == 0;
+			     done += n) {
+				n = MIN(ZERO_CHUNK, s->file_size - done);
+				if (pwrite(fd, zeros, n, done) != (ssize_t)n)
+					err = -1;
+			}
+			break;
+		default:
+			break;
+		}
+		if (err == 0)
+			err = fsync(fd);
+		if (err != 0)
+			printf("Can't prepare segment %d: %s\n", i,
+			    strerror(errno));
+		close(fd);
+	}
+
+	free(zeros);
+	if (err == 0)
+		printf("Prepared %d segments\n", s->file_count);
+	return (err);
+}
+
+static void w_syncer_run(struct meter_settings *, int);
+
+/*
+ * Rewind the log to the first segment, nobody holds the locks between runs.
+ * The SYNCER mode gets a fresh syncer process for every run.
+ */
+int
+w_write_sync_reset(struct meter_settings *s, int dirfd)
+{
+	pid_t pid;
+
+	w_state->position_write = 0;
+	w_state->position_sync = 0;
+	w_state->gc_head = 0;
+	w_state->gc_leader = 0;
+	w_state->sync_seq = 0;
+	memset(w_phases, 0, sizeof(struct w_phase_stats) * s->ncpu);
+
+	if (prepare_segments(s, dirfd) != 0)
+		return (-1);
+
+	lock_reset(w_state->mx_write, s->ncpu);
+	lock_reset(w_state->mx_sync, s->ncpu);
+
+	if (w_params.w_mode == SYNCER) {
+		w_state->write_seq = 0;
+		w_state->syncer_sleeping = 0;
+		w_state->workers_done = 0;
+		w_state->syncer_stop = 0;
+
+		fflush(stdout);
+		pid = fork();
+		if (pid == -1) {
+			printf("Can't fork syncer: %s\n", strerror(errno));
+			return (-1);
+		}
+		if (pid == 0) {
+			w_syncer_run(s, dirfd);
+			exit(0);
+		}
+	}
 
 	return (0);
 }
 
+/* A commit of the URING mode: reserved range and its linked SQEs */
+typedef struct w_uring_commit {
+	unsigned long start_pos;
+	unsigned long end_pos;
+	uint64_t start;	 /* Operation start mark */
+	int first_index; /* First segment touched by the commit */
+	int inflight;	 /* SQEs not completed yet */
+} w_uring_commit_t;
+
+typedef struct w_uring_ctx {
+	struct meter_uring ring;
+	struct w_uring_commit *commits;
+	int head;  /* Oldest commit in flight */
+	int count; /* Commits in flight */
+	int *fds;  /* Segment descriptors, opened lazily */
+	int fd_low; /* Segments below are closed for good */
+	int flags;
+	int dirfd;
+	char *data;
+} w_uring_ctx_t;
+
+static int
+uring_segment_fd(struct w_uring_ctx *u, int index)
+{
+	if (u->fds[index] < 0)
+		u->fds[index] = open_segment(u->dirfd, index, u->flags);
+	return (u->fds[index]);
+}
+
+/*
+ * Queue WRITE -> FSYNC(DATASYNC) per touched segment, all linked into one
+ * chain, so that the flush of a segment never overtakes its write.
+ */
+static int
+uring_submit_commit(struct w_uring_ctx *u, struct meter_worker_state *s,
+    int slot)
+{
+	struct w_uring_commit *c = &u->commits[slot];
+	struct io_uring_sqe *sqe = NULL;
+	unsigned long pos, pos_in_file, bytes_to_write, shift;
+	unsigned long file_size = s->settings->file_size;
+	int index, fd;
+
+	c->inflight = 0;
+	c->first_index = c->start_pos / file_size;
+
+	for (pos = c->start_pos; pos < c->end_pos;) {
+		index = pos / file_size;
+		pos_in_file = pos % file_size;
+		bytes_to_write = MIN(c->end_pos, (index + 1UL) * file_size) - pos;
+		if (pos_in_file > (unsigned long)w_params.shift_position) {
+			shift = w_params.shift_position;
+			pos_in_file -= w_params.shift_position;
+			bytes_to_write += w_params.shift_position;
+		} else {
+			shift = 0;
+		}
+		pos += bytes_to_write - shift;
+
+		fd = uring_segment_fd(u, index);
+		if (fd < 0) {
+			s->my_stats->errors++;
+			continue;
+		}
+
+		sqe = uring_get_sqe(&u->ring);
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = fd;
+		sqe->addr = (uint64_t)(uintptr_t)&u->data[pos_in_file];
+		sqe->len = bytes_to_write;
+		sqe->off = pos_in_file;
+		sqe->flags = IOSQE_IO_LINK;
+		if (w_params.durability == DUR_RWFDSYNC)
+			sqe->rw_flags = RWF_DSYNC;
+		sqe->user_data = slot;
+		c->inflight++;
+
+		if (w_params.durability == DUR_SYNCRANGE) {
+			sqe = uring_get_sqe(&u->ring);
+			sqe->opcode = IORING_OP_SYNC_FILE_RANGE;
+			sqe->fd = fd;
+			sqe->off = pos_in_file;
+			sqe->len = bytes_to_write;
+			sqe->sync_range_flags = SYNC_FILE_RANGE_WRITE;
+			sqe->flags = IOSQE_IO_LINK;
+			sqe->user_data = slot;
+			c->inflight++;
+		}
+
+		/* Writes are durable by themselves, the link ends with them */
+		if (w_params.durability == DUR_ODSYNC ||
+		    w_params.durability == DUR_RWFDSYNC) {
+			if (pos >= c->end_pos)
+				sqe->flags = 0;
+			continue;
+		}
+
+		sqe = uring_get_sqe(&u->ring);
+		sqe->opcode = IORING_OP_FSYNC;
+		sqe->fd = fd;
+		sqe->fsync_flags = w_params.durability == DUR_FSYNC ? 0 :
+		    IORING_FSYNC_DATASYNC;
+		sqe->flags = pos < c->end_pos ? IOSQE_IO_LINK : 0;
+		sqe->user_data = slot;
+		c->inflight++;
+	}
+
+	if (c->inflight == 0)
+		return (0);
+	/* The chain ends here even when the last segment was skipped */
+	sqe->flags &= ~IOSQE_IO_LINK;
+	return (uring_submit(&u->ring, 0));
+}
+
+static void
+uring_account_cqe(struct w_uring_ctx *u, struct meter_worker_state *s,
+    struct io_uring_cqe *cqe)
+{
+	if (cqe->res < 0) {
+		s->my_stats->errors++;
+	} else {
+		s->my_stats->bytes += cqe->res;
+	}
+	u->commits[cqe->user_data].inflight--;
+	uring_cqe_seen(&u->ring);
+}
+
+/*
+ * Wait for the oldest commit, then publish it. position_sync must stay
+ * contiguous, so a range is published only after every range before it.
+ */
+static void
+uring_complete_oldest(struct w_uring_ctx *u, struct meter_worker_state *s)
+{
+	struct w_uring_commit *c = &u->commits[u->head];
+	struct io_uring_cqe *cqe;
+	uint64_t t;
+	int low;
+
+	t = vi_tmGetTicks();
+	while (c->inflight > 0) {
+		cqe = uring_wait_cqe(&u->ring);
+		if (cqe == NULL) {
+			printf("io_uring wait failed: %s\n", strerror(errno));
+			exit(1);
+		}
+		uring_account_cqe(u, s, cqe);
+	}
+
+	while (__atomic_load_n(&w_state->position_sync, __ATOMIC_ACQUIRE) <
+	    c->start_pos)
+		sched_yield();
+	phase_record(s, PH_WAIT, vi_tmGetTicks() - t);
+	update_fsync_pos(c->end_pos);
+	meter_op_record(s, vi_tmGetTicks() - c->start);
+
+	u->head = (u->head + 1) % w_params.uring_qd;
+	u->count--;
+
+	/* Segments behind every reservation are never touched again */
+	low = c->end_pos / s->settings->file_size;
+	if (u->count > 0)
+		low = MIN(low, u->commits[u->head].first_index);
+	for (; u->fd_low < low; u->fd_low++) {
+		if (u->fds[u->fd_low] >= 0) {
+			close(u->fds[u->fd_low]);
+			u->fds[u->fd_low] = -1;
+		}
+	}
+}
+
+/*
+ * Take whatever completions are there and publish the commits that are
+ * durable and next in line, without waiting. Called on every pass, so a
+ * commit's latency does not include the time until the queue fills up.
+ */
+static void
+uring_complete_ready(struct w_uring_ctx *u, struct meter_worker_state *s)
+{
+	struct io_uring_cqe *cqe;
+	struct w_uring_commit *c;
+
+	while ((cqe = uring_peek_cqe(&u->ring)) != NULL)
+		uring_account_cqe(u, s, cqe);
+
+	while (u->count > 0) {
+		c = &u->commits[u->head];
+		if (c->inflight > 0 ||
+		    __atomic_load_n(&w_state->position_sync,
+			__ATOMIC_ACQUIRE) < c->start_pos)
+			break;
+		uring_complete_oldest(u, s);
+	}
+}
+
+static long
+w_write_sync_uring_job(int workerid, struct meter_worker_state *s, int dirfd)
+{
+	struct w_uring_ctx u;
+	struct w_uring_commit *c;
+	unsigned long needed_pos, log_end;
+	unsigned int seed;
+	uint64_t start;
+	int err, slot;
+
+	memset(&u, 0, sizeof(u));
+	u.dirfd = dirfd;
+	/* Commits stay inside the log, a missing segment is an error */
+	u.flags = segment_flags() & ~O_CREAT;
+	log_end = (unsigned long)s->settings->file_count *
+	    s->settings->file_size;
+
+	err = uring_init(&u.ring, uring_entries(s->settings), 0);
+	if (err != 0) {
+		printf("[%d] Can't set up io_uring: %s\n", workerid,
+		    strerror(-err));
+		return (-1);
+	}
+
+	u.data = alloc_rndbytes(s->settings, s->settings->file_size);
+	u.commits = calloc(w_params.uring_qd, sizeof(struct w_uring_commit));
+	u.fds = malloc(s->settings->file_count * sizeof(int));
+	if (u.data == NULL || u.commits == NULL || u.fds == NULL) {
+		printf("[%d] Can't allocate commit queue\n", workerid);
+		return (-1);
+	}
+	for (int i = 0; i < s->settings->file_count; i++)
+		u.fds[i] = -1;
+
+	seed = workerid;
+	for (;;) {
+		needed_pos = w_state->position_write + MIN_CHUNKSIZE +
+		    rand_r(&seed) % CHUNKSIZE;
+		if (needed_pos > log_end || meter_stopped(s))
+			break;
+
+		DO_WORK(20);
+
+		uring_complete_ready(&u, s);
+		if (u.count == w_params.uring_qd)
+			uring_complete_oldest(&u, s);
+
+		start = meter_op_begin(s);
+		DO_LOCK(w_state->mx_write, PH_WLOCK);
+		if (w_state->position_sync >= needed_pos) {
+			phase_commit(s, 1);
+			DO_UNLOCK(w_state->mx_write);
+			continue;
+		}
+		slot = (u.head + u.count) % w_params.uring_qd;
+		c = &u.commits[slot];
+		c->start = start;
+		if (w_state->position_write >= needed_pos) {
+			/*
+			 * Already written by someone else and in flight: an
+			 * empty commit just waits until it gets published.
+			 */
+			c->start_pos = needed_pos;
+			c->end_pos = needed_pos;
+			phase_commit(s, 1);
+		} else {
+			c->start_pos = w_state->position_write;
+			c->end_pos = needed_pos;
+			w_state->position_write = needed_pos;
+			phase_commit(s, 0);
+		}
+		DO_UNLOCK(w_state->mx_write);
+
+		u.count++;
+		err = uring_submit_commit(&u, s, slot);
+		if (err < 0) {
+			printf("[%d] io_uring submit failed: %s\n", workerid,
+			    strerror(-err));
+			exit(1);
+		}
+	}
+
+	while (u.count > 0)
+		uring_complete_oldest(&u, s);
+
+	for (int i = u.fd_low; i < s->settings->file_count; i++)
+		if (u.fds[i] >= 0)
+			close(u.fds[i]);
+	free(u.fds);
+	free(u.commits);
+	free(u.data);
+	uring_exit(&u.ring);
+
+	return (s->my_stats->ops);
+}
+
+/* Largest pwritev() of the leader, a batch is split when it has more */
+#define GC_IOV_MAX 1024
+
+typedef struct w_gc_ctx {
+	struct w_segfd seg;
+	char *data;
+	struct iovec iov[GC_IOV_MAX];
+	int iovcnt;
+	unsigned long iov_pos; /* Log position of iov[0] */
+} w_gc_ctx_t;
+
+static void
+gc_push(int workerid)
+{
+	struct gc_slot *slot = &w_state->gc_slots[workerid];
+	uint32_t head;
+
+	head = __atomic_load_n(&w_state->gc_head, __ATOMIC_RELAXED);
+	do {
+		slot->next = head;
+	} while (!__atomic_compare_exchange_n(&w_state->gc_head, &head,
+	    workerid + 1, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* Write out the gathered iovecs, they all belong to the current segment */
+static void
+gc_flush(struct w_gc_ctx *g, struct meter_worker_state *s)
+{
+	ssize_t res;
+
+	uint64_t t;
+
+	if (g->iovcnt == 0)
+		return;
+
+	t = vi_tmGetTicks();
+	res = segment_writev(g->seg.fd, g->iov, g->iovcnt,
+	    g->iov_pos % s->settings->file_size);
+	phase_record(s, PH_WRITE, vi_tmGetTicks() - t);
+	if (res < 0)
+		s->my_stats->errors++;
+	else
+		s->my_stats->bytes += res;
+	g->iovcnt = 0;
+}
+
+static void
+gc_sync(struct w_gc_ctx *g, struct meter_worker_state *s)
+{
+	uint64_t t;
+
+	t = vi_tmGetTicks();
+	if (segment_sync(g->seg.fd) != 0) {
+		printf("sync failed with error %s\n", strerror(errno));
+		exit(1);
+	}
+	phase_record(s, PH_FLUSH, vi_tmGetTicks() - t);
+}
+
+/* Switch to segment index, the previous one is complete and made durable */
+static void
+gc_segment(struct w_gc_ctx *g, struct meter_worker_state *s, int index)
+{
+	if (g->seg.index == index)
+		return;
+
+	gc_flush(g, s);
+	if (g->seg.fd >= 0)
+		gc_sync(g, s);
+	if (segfd_get(&g->seg, index) < 0) {
+		printf("Can't open segment %d: %s\n", index, strerror(errno));
+		exit(1);
+	}
+}
+
+/*
+ * Leader: take every pending request at once, append them to the log in
+ * arrival order with as few pwritev() calls as the segments allow, make
+ * them durable with one fdatasync() and mark them done. Only the leader
+ * moves position_write in this mode. Returns whether the batch carried
+ * the leader's own request.
+ */
+static int
+gc_lead(struct w_gc_ctx *g, struct meter_worker_state *s, int workerid)
+{
+	unsigned long log_end, pos, len, off, piece;
+	uint32_t order[MAX_WORKERS], result[MAX_WORKERS], idx;
+	struct gc_slot *slot;
+	int n = 0, index, own = 0;
+
+	log_end = (unsigned long)s->settings->file_count *
+	    s->settings->file_size;
+
+	idx = __atomic_exchange_n(&w_state->gc_head, 0, __ATOMIC_ACQUIRE);
+	for (; idx != 0; idx = w_state->gc_slots[idx - 1].next)
+		order[n++] = idx - 1;
+	if (n == 0)
+		return (0);
+
+	/* The stack is LIFO, commit in arrival order */
+	pos = w_state->position_write;
+	for (int i = n - 1; i >= 0; i--) {
+		slot = &w_state->gc_slots[order[i]];
+		/* Requests past the end of the log are not written */
+		result[i] = pos + slot->len > log_end ? GC_EXHAUSTED : GC_DONE;
+		if (result[i] == GC_EXHAUSTED)
+			continue;
+		for (len = slot->len; len > 0; len -= piece) {
+			index = pos / s->settings->file_size;
+			off = pos % s->settings->file_size;
+			piece = MIN(len, s->settings->file_size - off);
+			gc_segment(g, s, index);
+			if (g->iovcnt == GC_IOV_MAX)
+				gc_flush(g, s);
+			if (g->iovcnt == 0)
+				g->iov_pos = pos;
+			g->iov[g->iovcnt].iov_base = &g->data[off];
+			g->iov[g->iovcnt].iov_len = piece;
+			g->iovcnt++;
+			pos += piece;
+		}
+	}
+	gc_flush(g, s);
+	if (pos > w_state->position_write) {
+		gc_sync(g, s);
+		w_state->position_write = pos;
+		update_fsync_pos(pos);
+	}
+
+	for (int i = 0; i < n; i++) {
+		if (order[i] == (uint32_t)workerid)
+			own = 1;
+		__atomic_store_n(&w_state->gc_slots[order[i]].state, result[i],
+		    __ATOMIC_RELEASE);
+	}
+	return (own);
+}
+
+/*
+ * Wait until the own request is durable. Whoever finds the leader role
+ * free takes it. The leader gives the role up before bumping sync_seq,
+ * so a waiter that read the new sequence either gets the role or knows
+ * that another leader will bump it again.
+ */
+static enum gc_state
+gc_commit(struct w_gc_ctx *g, struct meter_worker_state *s, int workerid,
+    unsigned long len)
+{
+	struct gc_slot *slot = &w_state->gc_slots[workerid];
+	uint32_t seq, state, free_role;
+	uint64_t t;
+	int own = 0;
+
+	slot->len = len;
+	slot->state = GC_PENDING;
+	gc_push(workerid);
+
+	for (;;) {
+		seq = __atomic_load_n(&w_state->sync_seq, __ATOMIC_ACQUIRE);
+		state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+		if (state != GC_PENDING) {
+			if (state == GC_DONE)
+				phase_commit(s, !own);
+			return (state);
+		}
+
+		free_role = 0;
+		if (__atomic_compare_exchange_n(&w_state->gc_leader, &free_role,
+			1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			own |= gc_lead(g, s, workerid);
+			__atomic_store_n(&w_state->gc_leader, 0,
+			    __ATOMIC_RELEASE);
+			__atomic_add_fetch(&w_state->sync_seq, 1,
+			    __ATOMIC_RELEASE);
+			futex_wake(&w_state->sync_seq, INT_MAX);
+			continue;
+		}
+		t = vi_tmGetTicks();
+		futex_wait(&w_state->sync_seq, seq);
+		phase_record(s, PH_WAIT, vi_tmGetTicks() - t);
+	}
+}
+
+static long
+w_write_sync_gc_job(int workerid, struct meter_worker_state *s, int dirfd)
+{
+	struct w_gc_ctx *g;
+	unsigned int seed;
+	uint64_t start;
+	long ret;
+
+	g = calloc(1, sizeof(struct w_gc_ctx));
+	if (g == NULL) {
+		printf("[%d] Can't allocate commit context\n", workerid);
+		return (-1);
+	}
+	segfd_init(&g->seg, dirfd,
+	    segment_flags());
+	g->data = alloc_rndbytes(s->settings, s->settings->file_size);
+	if (g->data == NULL) {
+		printf("[%d] Can't allocate data\n", workerid);
+		free(g);
+		return (-1);
+	}
+
+	seed = workerid;
+	while (!meter_stopped(s)) {
+		DO_WORK(20);
+
+		start = meter_op_begin(s);
+		if (gc_commit(g, s, workerid,
+			MIN_CHUNKSIZE + rand_r(&seed) % CHUNKSIZE) != GC_DONE)
+			break;
+		meter_op_end(s, start);
+		segfd_preopen(&g->seg, s->settings);
+	}
+
+	ret = s->my_stats->ops;
+	segfd_close(&g->seg);
+	free(g->data);
+	free(g);
+	return (ret);
+}
+
+/*
+ * Syncer process: flush everything written so far, publish it and wake
+ * the waiting workers. Sleeps on write_seq when there is nothing to flush
+ * and exits once every worker is done.
+ */
+static void
+w_syncer_run(struct meter_settings *s, int dirfd)
+{
+	struct timespec delay = { .tv_sec = w_params.syncer_delay_us / 1000000,
+		.tv_nsec = (w_params.syncer_delay_us % 1000000) * 1000 };
+	unsigned long target, synced = 0, flushed = 0;
+	uint64_t t, flush_ticks = 0, first_ns = 0, last_ns = 0;
+	struct w_segfd sf;
+	long flushes = 0;
+	uint32_t seq;
+	int fd, index;
+
+	segfd_init(&sf, dirfd,
+	    segment_flags());
+	for (;;) {
+		seq = __atomic_load_n(&w_state->write_seq, __ATOMIC_SEQ_CST);
+		target = __atomic_load_n(&w_state->position_write,
+		    __ATOMIC_ACQUIRE);
+		if (target > synced) {
+			t = vi_tmGetTicks();
+			/* Every segment touched since the previous flush */
+			for (index = synced / s->file_size;
+			     index <= (int)((target - 1) / s->file_size);
+			     index++) {
+				fd = segfd_get(&sf, index);
+				if (fd < 0 || segment_sync(fd) != 0) {
+					printf("[syncer] sync failed with error %s\n",
+					    strerror(errno));
+					exit(1);
+				}
+			}
+			flush_ticks += vi_tmGetTicks() - t;
+			flushed += target - synced;
+			flushes++;
+			synced = target;
+			update_fsync_pos(target);
+			__atomic_add_fetch(&w_state->sync_seq, 1, __ATOMIC_RELEASE);
+			futex_wake(&w_state->sync_seq, INT_MAX);
+
+			last_ns = meter_now_ns();
+			if (first_ns == 0)
+				first_ns = last_ns;
+			segfd_preopen(&sf, s);
+			if (w_params.syncer_delay_us > 0)
+				nanosleep(&delay, NULL);
+			continue;
+		}
+		if (__atomic_load_n(&w_state->workers_done, __ATOMIC_ACQUIRE) ==
+			s->ncpu ||
+		    __atomic_load_n(&w_state->syncer_stop, __ATOMIC_ACQUIRE))
+			break;
+
+		/* Writers look at the flag after bumping write_seq */
+		__atomic_store_n(&w_state->syncer_sleeping, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&w_state->position_write,
+			__ATOMIC_SEQ_CST) == synced &&
+		    __atomic_load_n(&w_state->workers_done, __ATOMIC_SEQ_CST) <
+			s->ncpu &&
+		    !__atomic_load_n(&w_state->syncer_stop, __ATOMIC_SEQ_CST))
+			futex_wait(&w_state->write_seq, seq);
+		__atomic_store_n(&w_state->syncer_sleeping, 0, __ATOMIC_RELAXED);
+	}
+
+	segfd_close(&sf);
+	printf("[syncer] flushes = %ld, flushes/s = %.1f, avg flush = %.0f ns, "
+	       "avg batch = %.1f KB\n",
+	    flushes,
+	    last_ns > first_ns ? flushes * 1e9 / (last_ns - first_ns) : 0.0,
+	    flushes > 0 ? s->ns_per_tick * flush_ticks / flushes : 0.0,
+	    flushes > 0 ? flushed / 1024.0 / flushes : 0.0);
+	fflush(stdout);
+}
+
+static void
+syncer_notify(void)
+{
+	__atomic_add_fetch(&w_state->write_seq, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&w_state->syncer_sleeping, __ATOMIC_SEQ_CST))
+		futex_wake(&w_state->write_seq, 1);
+}
+
+/*
+ * Workers that failed before their job or died never count themselves
+ * done, so the parent stops the syncer once all of them are gone.
+ */
+void
+w_write_sync_finish(struct meter_settings *s)
+{
+	(void)s;
+
+	if (w_params.w_mode != SYNCER)
+		return;
+	__atomic_store_n(&w_state->syncer_stop, 1, __ATOMIC_SEQ_CST);
+	syncer_notify();
+}
+
+/* Workers of the SYNCER mode write under mx_write and wait for the syncer */
+static long
+w_write_sync_syncer_job(int workerid, struct meter_worker_state *s, int dirfd)
+{
+	unsigned long pos, end, log_end, off, piece;
+	struct w_segfd sf;
+	ssize_t write_res;
+	unsigned int seed;
+	uint64_t start, t;
+	uint32_t seq;
+	char *data;
+
+	data = alloc_rndbytes(s->settings, s->settings->file_size);
+	if (data == NULL) {
+		printf("[%d] Can't allocate data\n", workerid);
+		goto done;
+	}
+	segfd_init(&sf, dirfd,
+	    segment_flags());
+	log_end = (unsigned long)s->settings->file_count *
+	    s->settings->file_size;
+	seed = workerid;
+
+	while (!meter_stopped(s)) {
+		DO_WORK(20);
+
+		start = meter_op_begin(s);
+		DO_LOCK(w_state->mx_write, PH_WLOCK);
+		pos = w_state->position_write;
+		end = pos + MIN_CHUNKSIZE + rand_r(&seed) % CHUNKSIZE;
+		if (end > log_end) {
+			DO_UNLOCK(w_state->mx_write);
+			break;
+		}
+		for (; pos < end; pos += piece) {
+			off = pos % s->settings->file_size;
+			piece = MIN(end - pos, s->settings->file_size - off);
+			t = vi_tmGetTicks();
+			write_res = segment_write(segfd_get(&sf,
+			    pos / s->settings->file_size), &data[off], piece, off);
+			phase_record(s, PH_WRITE, vi_tmGetTicks() - t);
+			if (write_res < 0)
+				s->my_stats->errors++;
+			else
+				s->my_stats->bytes += write_res;
+		}
+		__atomic_store_n(&w_state->position_write, end, __ATOMIC_RELEASE);
+		DO_UNLOCK(w_state->mx_write);
+		syncer_notify();
+		segfd_preopen(&sf, s->settings);
+
+		t = vi_tmGetTicks();
+		for (;;) {
+			seq = __atomic_load_n(&w_state->sync_seq,
+			    __ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&w_state->position_sync,
+				__ATOMIC_ACQUIRE) >= end)
+				break;
+			futex_wait(&w_state->sync_seq, seq);
+		}
+		phase_record(s, PH_WAIT, vi_tmGetTicks() - t);
+		/* The syncer flushes every commit */
+		phase_commit(s, 1);
+		meter_op_end(s, start);
+	}
+
+	segfd_close(&sf);
+	free(data);
+done:
+	__atomic_add_fetch(&w_state->workers_done, 1, __ATOMIC_RELEASE);
+	syncer_notify();
+	return (s->my_stats->ops);
+}
+
 long
 w_write_sync_job(int workerid, struct meter_worker_state *s, int dirfd)
 {
-	char filename[128];
-	int fd, err, curr_index, flags;
+	int fd, err, curr_index, flags, flushed;
 	ssize_t write_res;
 	long position_to_add;
 	unsigned long needed_pos;
 	long write_pos_diff;
 	unsigned long save_write_pos;
+	uint64_t start;
+	unsigned int seed; /* rand_r(): workers may be threads */
+	uint64_t t;
+	struct w_segfd sf;
 
-	curr_index = WORKER_FILE_INDEX(s);
+	s->opaque = &w_phases[workerid];
+	if (w_params.w_mode == URING)
+		return (w_write_sync_uring_job(workerid, s, dirfd));
+	if (w_params.w_mode == GROUPCOMMIT)
+		return (w_write_sync_gc_job(workerid, s, dirfd));
+	if (w_params.w_mode == SYNCER)
+		return (w_write_sync_syncer_job(workerid, s, dirfd));
 
-	char *data = alloc_rndbytes(s->settings->file_size);
-	sprintf(filename, "temp_syscallmeter/file_%d", curr_index);
+	curr_index = WORKER_FILE_INDEX(s);
 
-	flags = O_CREAT | O_RDWR | (((w_params.direct != 0) ? O_DIRECT : 0));
-	fd = open(filename, flags, 0644);
-	srandom(workerid);
+	char *data = alloc_rndbytes(s->settings, s->settings->file_size);
+	flags = segment_flags();
+	segfd_init(&sf, dirfd, flags);
+	fd = segfd_get(&sf, curr_index);
+	seed = workerid;
 
 	for (;;) {
-		position_to_add = MIN_CHUNKSIZE + random() % CHUNKSIZE;
+		position_to_add = MIN_CHUNKSIZE + rand_r(&seed) % CHUNKSIZE;
 		needed_pos = w_state->position_write + position_to_add;
-		if (WORKER_FILE_INDEX(s) >= s->settings->file_count)
+		if (WORKER_FILE_INDEX(s) >= s->settings->file_count ||
+		    meter_stopped(s))
 			break;
 
 		DO_WORK(20);
 
-		DO_LOCK(&w_state->mx_write);
+		start = meter_op_begin(s);
+		DO_LOCK(w_state->mx_write, PH_WLOCK);
 
 		if (w_state->position_sync >= needed_pos)
 		{
 			//__asm__ __volatile__ ("lock; addl $0,0(%%rsp)" : : : "memory", "cc");
-			DO_UNLOCK(&w_state->mx_write);
+			phase_commit(s, 1);
+			DO_UNLOCK(w_state->mx_write);
 			continue;
 		}
+		flushed = 0;
 		write_pos_diff = (long) needed_pos - (long) w_state->position_write;
 		while (write_pos_diff > 0)
 		{
@@ -223,31 +1326,36 @@ w_write_sync_job(int workerid, struct meter_worker_state *s, int dirfd)
 			}
 			if (curr_index != index_to_open)
 			{
-				close(fd);
-				// TODO: err check
 				curr_index = WORKER_FILE_INDEX(s);
-				sprintf(filename, "temp_syscallmeter/file_%d", curr_index);
-				fd = open(filename, flags, 0644);
+				fd = segfd_get(&sf, curr_index);
 				// TODO: err check
 			}
-			pwrite(fd, &data[pos_in_file], bytes_to_write, pos_in_file);
-			// TODO: err check
+			t = vi_tmGetTicks();
+			write_res = segment_write(fd, &data[pos_in_file], bytes_to_write, pos_in_file);
+			phase_record(s, PH_WRITE, vi_tmGetTicks() - t);
+			if (write_res < 0)
+				s->my_stats->errors++;
+			else
+				s->my_stats->bytes += write_res;
 			w_state->position_write += bytes_to_write - shift;
 			write_pos_diff -= bytes_to_write - shift;
 			if (index_to_open != WORKER_FILE_INDEX(s))
 			{
-				fdatasync(fd);
+				t = vi_tmGetTicks();
+				segment_sync(fd);
+				phase_record(s, PH_FLUSH, vi_tmGetTicks() - t);
+				flushed = 1;
 				update_fsync_pos(w_state->position_write);
 			}
 		}
 		switch (w_params.w_mode) {
 		case DUAL:
 		case EXWR_SHSY:
-			DO_LOCK(&w_state->mx_sync);
-			DO_UNLOCK(&w_state->mx_write);
+			DO_LOCK(w_state->mx_sync, PH_SLOCK);
+			DO_UNLOCK(w_state->mx_write);
 			break;
 		case ONLYWRITE:
-			DO_UNLOCK(&w_state->mx_write);
+			DO_UNLOCK(w_state->mx_write);
 			break;
 		default:
 			break;
@@ -257,39 +1365,88 @@ w_write_sync_job(int workerid, struct meter_worker_state *s, int dirfd)
 		{
 			if (curr_index != WORKER_FILE_INDEX_SYNC(needed_pos, s))
 			{
-				close(fd);
-				// TODO: err check
 				curr_index = WORKER_FILE_INDEX_SYNC(needed_pos, s);
-				sprintf(filename, "temp_syscallmeter/file_%d", curr_index);
-				fd = open(filename, flags, 0644);
+				fd = segfd_get(&sf, curr_index);
 				// TODO: err check
 			}
-			err = fdatasync(fd);
+			t = vi_tmGetTicks();
+			err = segment_sync(fd);
+			phase_record(s, PH_FLUSH, vi_tmGetTicks() - t);
+			flushed = 1;
 			if (err != 0) {
-				printf("fdatasync failed with error %s\n",
+				printf("sync failed with error %s\n",
 			    	strerror(errno));
 				exit(1);
 			}
 			save_write_pos = MIN(save_write_pos, (curr_index + 1) * s->settings->file_size);
 			update_fsync_pos(save_write_pos);
 		}
-		s->my_stats->cycles++;
+		/* Synced past needed_pos while we waited for mx_sync */
+		phase_commit(s, !flushed);
+		meter_op_end(s, start);
 
 		switch (w_params.w_mode) {
 		case JOINED:
-			DO_UNLOCK(&w_state->mx_write);
+			DO_UNLOCK(w_state->mx_write);
 			break;
 		case DUAL:
 		case EXWR_SHSY:
-			DO_UNLOCK(&w_state->mx_sync);
+			DO_UNLOCK(w_state->mx_sync);
 			break;
 		default:
 			break;
 		}
+		segfd_preopen(&sf, s->settings);
 	}
 
 	free(data);
-	close(fd);
+	segfd_close(&sf);
+
+	return (s->my_stats->ops);
+}
+
+/*
+ * Where the time of a commit goes, summed over all workers, and how many
+ * commits were made durable by a flush of another worker (group commit).
+ */
+void
+w_write_sync_report(struct meter_settings *s)
+{
+	struct meter_histo *total;
+	uint64_t commits = 0, skipped = 0, all = 0;
+	double tick = s->ns_per_tick;
+
+	total = calloc(PH_COUNT, sizeof(struct meter_histo));
+	if (total == NULL) {
+		printf("Can't allocate phase results\n");
+		return;
+	}
+	for (long i = 0; i < s->ncpu; i++) {
+		for (int ph = 0; ph < PH_COUNT; ph++)
+			histo_merge(&total[ph], &w_phases[i].histo[ph]);
+		commits += w_phases[i].commits;
+		skipped += w_phases[i].skipped;
+	}
+	for (int ph = 0; ph < PH_COUNT; ph++)
+		all += total[ph].sum;
+
+	printf("Commit phases (ns):\n");
+	printf("%-10s %12s %7s %10s %10s %10s %10s %10s\n", "phase", "count",
+	    "share", "avg", "p50", "p99", "p99.9", "max");
+	for (int ph = 0; ph < PH_COUNT; ph++) {
+		struct meter_histo *h = &total[ph];
+
+		if (h->count == 0)
+			continue;
+		printf("%-10s %12lu %6.1f%% %10.0f %10.0f %10.0f %10.0f "
+		       "%10.0f\n",
+		    w_phase_names[ph], h->count, 100.0 * h->sum / all,
+		    tick * h->sum / h->count, tick * histo_percentile(h, 50.0),
+		    tick * histo_percentile(h, 99.0),
+		    tick * histo_percentile(h, 99.9), tick * h->max);
+	}
+	printf("Commits: %lu, by another flush: %lu, group commit ratio %.3f\n",
+	    commits, skipped, commits > 0 ? (double)skipped / commits : 0.0);
 
-	return (s->my_stats->cycles);
+	free(total);
 }
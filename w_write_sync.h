@@ -5,6 +5,9 @@
 int w_write_sync_option(char*);
 
 int w_write_sync_init(struct meter_settings *, int);
+int w_write_sync_reset(struct meter_settings *, int);
 long w_write_sync_job(int, struct meter_worker_state *, int);
+void w_write_sync_finish(struct meter_settings *);
+void w_write_sync_report(struct meter_settings *);
 
 #endif /* !_W_WRITE_SYNC_H_ */
@@ -25,12 +25,15 @@ w_write_unlink_job(int workerid, struct meter_worker_state *s, int dirfd)
 	char filename[128];
 	int fd;
 	ssize_t write_res;
+	uint64_t start;
 
-	char *data = alloc_rndbytes(s->settings->file_size);
+	char *data = alloc_rndbytes(s->settings, s->settings->file_size);
 	sprintf(filename, FNAME, workerid);
-	for (long i = 0; i < s->settings->cycles; i++) {
+	for (long i = 0; meter_continue(s, i); i++) {
+		start = meter_op_begin(s);
 		fd = openat(dirfd, filename, O_CREAT | O_TRUNC | O_RDWR, 0644);
 		if (fd < 0) {
+			s->my_stats->errors++;
 			printf("[%d] Can't create or open file %s: %s\n",
 			    workerid, filename, strerror(errno));
 			close(fd);
@@ -38,6 +41,7 @@ w_write_unlink_job(int workerid, struct meter_worker_state *s, int dirfd)
 		}
 		write_res = write(fd, data, s->settings->file_size);
 		if (write_res != s->settings->file_size) {
+			s->my_stats->errors++;
 			printf("[%d] Can't write file %s: %s\n", workerid,
 			    filename, strerror(errno));
 			close(fd);
@@ -45,12 +49,14 @@ w_write_unlink_job(int workerid, struct meter_worker_state *s, int dirfd)
 		}
 		close(fd);
 		if (unlinkat(dirfd, filename, 0) < 0) {
+			s->my_stats->errors++;
 			printf("[%d] Can't unlick file %s: %s\n", workerid,
 			    filename, strerror(errno));
 		}
-		s->my_stats->cycles++;
+		meter_op_end(s, start);
+		s->my_stats->bytes += write_res;
 	}
 	free(data);
 
-	return (s->my_stats->cycles);
+	return (s->my_stats->ops);
 }